@@ -0,0 +1,14 @@
+#ifndef __HOST_LINUX_ATOMIC_H_INCLUDED
+#define __HOST_LINUX_ATOMIC_H_INCLUDED
+
+#include <linux/types.h>
+
+typedef struct {
+	s64 counter;
+} atomic64_t;
+
+#define atomic64_read(v)     __atomic_load_n(&(v)->counter, __ATOMIC_RELAXED)
+#define atomic64_set(v, i)   __atomic_store_n(&(v)->counter, i, __ATOMIC_RELAXED)
+#define atomic64_xchg(v, i)  __atomic_exchange_n(&(v)->counter, i, __ATOMIC_SEQ_CST)
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef __HOST_LINUX_CTYPE_H_INCLUDED
+#define __HOST_LINUX_CTYPE_H_INCLUDED
+
+#include <ctype.h>
+
+#endif
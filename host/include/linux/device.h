@@ -0,0 +1,92 @@
+#ifndef __HOST_LINUX_DEVICE_H_INCLUDED
+#define __HOST_LINUX_DEVICE_H_INCLUDED
+
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/types.h>
+
+/*
+ * Just enough of the driver model for registration to run: devices carry
+ * their drvdata, and attributes are remembered so the host harness can call
+ * their show and store handlers directly.
+ */
+
+struct module;
+
+struct kobject {
+	const char *name;
+};
+
+struct attribute {
+	const char *name;
+	umode_t    mode;
+};
+
+struct device {
+	struct kobject kobj;
+	void           *driver_data;
+	char           name[64];
+};
+
+struct device_attribute {
+	struct attribute attr;
+	ssize_t (*show)(struct device *dev, struct device_attribute *attr, char *buf);
+	ssize_t (*store)(struct device *dev, struct device_attribute *attr,
+					 const char *buf, size_t count);
+};
+
+struct attribute_group {
+	const char        *name;
+	umode_t           (*is_visible)(struct kobject *kobj, struct attribute *attr, int n);
+	struct attribute  **attrs;
+};
+
+struct class {
+	const char *name;
+	char       *(*devnode)(const struct device *dev, umode_t *mode);
+};
+
+#define DEVICE_ATTR(_name, _mode, _show, _store) \
+	struct device_attribute dev_attr_##_name = { \
+		.attr = { .name = #_name, .mode = _mode }, .show = _show, .store = _store }
+#define DEVICE_ATTR_WO(_name) \
+	struct device_attribute dev_attr_##_name = { \
+		.attr = { .name = #_name, .mode = 0200 }, .store = _name##_store }
+#define DEVICE_ATTR_RW(_name) \
+	struct device_attribute dev_attr_##_name = { \
+		.attr = { .name = #_name, .mode = 0644 }, \
+		.show = _name##_show, .store = _name##_store }
+#define DEVICE_ATTR_RO(_name) \
+	struct device_attribute dev_attr_##_name = { \
+		.attr = { .name = #_name, .mode = 0444 }, .show = _name##_show }
+
+#define kobj_to_dev(k) container_of(k, struct device, kobj)
+
+#define dev_err(dev, fmt, ...)  printk(fmt, ##__VA_ARGS__)
+#define dev_warn(dev, fmt, ...) printk(fmt, ##__VA_ARGS__)
+#define dev_info(dev, fmt, ...) printk(fmt, ##__VA_ARGS__)
+
+static inline void *dev_get_drvdata(const struct device *dev)
+{
+	return dev->driver_data;
+}
+
+static inline const char *dev_name(const struct device *dev)
+{
+	return dev->name;
+}
+
+struct class  *class_create(const char *name);
+void          class_destroy(struct class *cls);
+struct device *device_create(struct class *cls, struct device *parent, dev_t devt,
+							 void *drvdata, const char *fmt, ...);
+void          device_unregister(struct device *dev);
+int           device_create_file(struct device *dev, const struct device_attribute *attr);
+void          device_remove_file(struct device *dev, const struct device_attribute *attr);
+int           sysfs_create_group(struct kobject *kobj, const struct attribute_group *grp);
+void          sysfs_remove_group(struct kobject *kobj, const struct attribute_group *grp);
+
+// Host-only: find an attribute by name, as created above
+struct device_attribute *mmio_host_find_attr(struct device *dev, const char *name);
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef __HOST_LINUX_IO_H_INCLUDED
+#define __HOST_LINUX_IO_H_INCLUDED
+
+#include <linux/types.h>
+
+// Banks are ordinary memory on the host; keep every access a real load/store
+#define __raw_readb(a)     (*(const volatile u8 *) (a))
+#define __raw_readw(a)     (*(const volatile u16 *) (a))
+#define __raw_readl(a)     (*(const volatile u32 *) (a))
+#define __raw_readq(a)     (*(const volatile u64 *) (a))
+#define __raw_writeb(v, a) (*(volatile u8 *) (a) = (v))
+#define __raw_writew(v, a) (*(volatile u16 *) (a) = (v))
+#define __raw_writel(v, a) (*(volatile u32 *) (a) = (v))
+#define __raw_writeq(v, a) (*(volatile u64 *) (a) = (v))
+
+#endif
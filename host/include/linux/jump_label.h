@@ -0,0 +1,25 @@
+#ifndef __HOST_LINUX_JUMP_LABEL_H_INCLUDED
+#define __HOST_LINUX_JUMP_LABEL_H_INCLUDED
+
+#include <linux/types.h>
+
+// A plain flag; there's no code patching on the host
+struct static_key_false {
+	bool enabled;
+	int  count;     // Of static_branch_inc not yet undone
+};
+
+#define DEFINE_STATIC_KEY_FALSE(name)  struct static_key_false name = { false }
+#define DECLARE_STATIC_KEY_FALSE(name) extern struct static_key_false name
+
+#define static_branch_unlikely(key) __builtin_expect(__atomic_load_n(&(key)->enabled, __ATOMIC_RELAXED), 0)
+#define static_branch_likely(key)   __builtin_expect(__atomic_load_n(&(key)->enabled, __ATOMIC_RELAXED), 1)
+#define static_key_enabled(key)     __atomic_load_n(&(key)->enabled, __ATOMIC_RELAXED)
+#define static_branch_enable(key)   __atomic_store_n(&(key)->enabled, true, __ATOMIC_RELAXED)
+#define static_branch_disable(key)  __atomic_store_n(&(key)->enabled, false, __ATOMIC_RELAXED)
+#define static_branch_inc(key) \
+	__atomic_store_n(&(key)->enabled, __atomic_add_fetch(&(key)->count, 1, __ATOMIC_RELAXED) > 0, __ATOMIC_RELAXED)
+#define static_branch_dec(key) \
+	__atomic_store_n(&(key)->enabled, __atomic_sub_fetch(&(key)->count, 1, __ATOMIC_RELAXED) > 0, __ATOMIC_RELAXED)
+
+#endif
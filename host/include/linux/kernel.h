@@ -0,0 +1,122 @@
+#ifndef __HOST_LINUX_KERNEL_H_INCLUDED
+#define __HOST_LINUX_KERNEL_H_INCLUDED
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <linux/types.h>
+
+#define KERN_ERR     ""
+#define KERN_WARNING ""
+#define KERN_INFO    ""
+#define KERN_DEBUG   ""
+
+// Quiet unless MMIO_HOST_VERBOSE is set, so benchmarks aren't flooded
+extern bool mmio_host_verbose;
+#define printk(fmt, ...) \
+	do { if (mmio_host_verbose) fprintf(stderr, fmt, ##__VA_ARGS__); } while (0)
+
+#define noinline __attribute__((noinline))
+#ifndef __always_inline
+#define __always_inline inline __attribute__((always_inline))
+#endif
+
+#define likely(x)   __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#define PAGE_SIZE     4096UL
+#define BIT(n)        (1UL << (n))
+
+#define container_of(ptr, type, member) \
+	((type *) ((char *) (ptr) - offsetof(type, member)))
+
+#define min(a, b) ({ typeof(a) _a = (a); typeof(b) _b = (b); _a < _b ? _a : _b; })
+#define max(a, b) ({ typeof(a) _a = (a); typeof(b) _b = (b); _a > _b ? _a : _b; })
+#define min_t(t, a, b) min((t) (a), (t) (b))
+
+#define READ_ONCE(x)     (*(const volatile typeof(x) *) &(x))
+#define WRITE_ONCE(x, v) (*(volatile typeof(x) *) &(x) = (v))
+#define smp_load_acquire(p)     __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define smp_store_release(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+
+#define WARN_ON(c) ({ bool _c = !!(c); \
+	if (unlikely(_c)) fprintf(stderr, "WARNING at %s:%d\n", __FILE__, __LINE__); _c; })
+#define WARN_ON_ONCE(c) ({ static bool _w; bool _c = !!(c); \
+	if (unlikely(_c) && !_w) { _w = true; fprintf(stderr, "WARNING at %s:%d\n", __FILE__, __LINE__); } _c; })
+
+// snprintf, but returns what was written like the kernel's
+#define scnprintf(buf, size, fmt, ...) ({ size_t _s = (size); \
+	int _n = _s ? snprintf(buf, _s, fmt, ##__VA_ARGS__) : 0; \
+	_n < 0 ? 0 : ((size_t) _n < _s ? _n : (int) _s - 1); })
+
+#define _RET_IP_ ((unsigned long) __builtin_return_address(0))
+
+#define EXPORT_SYMBOL(sym)
+#define EXPORT_SYMBOL_GPL(sym)
+
+static inline int fls64(u64 x)
+{
+	return x ? 64 - __builtin_clzll(x) : 0;
+}
+
+static inline unsigned long __ffs64(u64 word)
+{
+	return __builtin_ctzll(word);
+}
+
+static inline unsigned long long simple_strtoull(const char *cp, char **endp, unsigned int base)
+{
+	unsigned long long val = 0;
+
+	// Like the kernel's, and unlike strtoull: no whitespace, sign or errno
+	if (base == 10)
+	{
+		while (*cp >= '0' && *cp <= '9')
+			val = val * 10 + (*cp++ - '0');
+	}
+	if (endp)
+		*endp = (char *) cp;
+	return val;
+}
+
+static inline int kstrtou64(const char *s, unsigned int base, u64 *res)
+{
+	unsigned long long val;
+	char *end;
+
+	// Like the kernel's: no whitespace or sign, one trailing newline allowed
+	if (*s < '0' || *s > '9')
+		return -EINVAL;
+	errno = 0;
+	val = strtoull(s, &end, base);
+	if (errno == ERANGE)
+		return -ERANGE;
+	if (*end == '\n')
+		end++;
+	if (*end)
+		return -EINVAL;
+	*res = val;
+	return 0;
+}
+
+static inline int kstrtobool(const char *s, bool *res)
+{
+	switch (s ? s[0] : 0)
+	{
+		case 'y': case 'Y': case '1':
+			*res = true;
+			return 0;
+		case 'n': case 'N': case '0':
+			*res = false;
+			return 0;
+		case 'o': case 'O':
+			if (s[1] == 'n' || s[1] == 'N') { *res = true; return 0; }
+			if (s[1] == 'f' || s[1] == 'F') { *res = false; return 0; }
+			break;
+	}
+	return -EINVAL;
+}
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef __HOST_LINUX_KTIME_H_INCLUDED
+#define __HOST_LINUX_KTIME_H_INCLUDED
+
+#include <time.h>
+#include <linux/types.h>
+
+#define NSEC_PER_SEC  1000000000ULL
+#define NSEC_PER_USEC 1000ULL
+
+static inline u64 ktime_get_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64) ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+#endif
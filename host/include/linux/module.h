@@ -0,0 +1,18 @@
+#ifndef __HOST_LINUX_MODULE_H_INCLUDED
+#define __HOST_LINUX_MODULE_H_INCLUDED
+
+#define THIS_MODULE NULL
+
+#define MODULE_AUTHOR(x)
+#define MODULE_LICENSE(x)
+#define MODULE_DESCRIPTION(x)
+
+// The module's init and exit become plain functions for the host harness
+#define subsys_initcall(fn) int mmio_host_initcall(void) { return fn(); }
+#define module_init(fn)     subsys_initcall(fn)
+#define module_exit(fn)     void mmio_host_exitcall(void) { fn(); }
+
+int  mmio_host_initcall(void);
+void mmio_host_exitcall(void);
+
+#endif
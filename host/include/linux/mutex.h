@@ -0,0 +1,15 @@
+#ifndef __HOST_LINUX_MUTEX_H_INCLUDED
+#define __HOST_LINUX_MUTEX_H_INCLUDED
+
+#include <pthread.h>
+
+struct mutex {
+	pthread_mutex_t lock;
+};
+
+#define mutex_init(m)    pthread_mutex_init(&(m)->lock, NULL)
+#define mutex_lock(m)    pthread_mutex_lock(&(m)->lock)
+#define mutex_unlock(m)  pthread_mutex_unlock(&(m)->lock)
+#define mutex_destroy(m) pthread_mutex_destroy(&(m)->lock)
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef __HOST_LINUX_NOTIFIER_H_INCLUDED
+#define __HOST_LINUX_NOTIFIER_H_INCLUDED
+
+// Notifiers aren't called on the host, see host/mmio_host.c
+struct notifier_block;
+
+struct atomic_notifier_head {
+	struct notifier_block *head;
+};
+
+#endif
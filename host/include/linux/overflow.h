@@ -0,0 +1,10 @@
+#ifndef __HOST_LINUX_OVERFLOW_H_INCLUDED
+#define __HOST_LINUX_OVERFLOW_H_INCLUDED
+
+#include <stddef.h>
+
+// Without the kernel's saturation; the host only sizes small allocations
+#define struct_size(p, member, count) \
+	(sizeof(*(p)) + (size_t) (count) * sizeof((p)->member[0]))
+
+#endif
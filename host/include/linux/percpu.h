@@ -0,0 +1,20 @@
+#ifndef __HOST_LINUX_PERCPU_H_INCLUDED
+#define __HOST_LINUX_PERCPU_H_INCLUDED
+
+#include <stdlib.h>
+#include <linux/types.h>
+
+/*
+ * One copy shared by all threads, updated atomically, so counters stay
+ * exact under the benchmarks' reader threads.
+ */
+
+#define alloc_percpu(type)       ((type *) calloc(1, sizeof(type)))
+#define free_percpu(ptr)         free(ptr)
+#define per_cpu_ptr(ptr, cpu)    (ptr)
+#define this_cpu_ptr(ptr)        (ptr)
+#define this_cpu_add(var, n)     __atomic_fetch_add(&(var), (n), __ATOMIC_RELAXED)
+#define this_cpu_inc(var)        this_cpu_add(var, 1)
+#define for_each_possible_cpu(cpu) for ((cpu) = 0; (cpu) < 1; (cpu)++)
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef __HOST_LINUX_RWSEM_H_INCLUDED
+#define __HOST_LINUX_RWSEM_H_INCLUDED
+
+#include <pthread.h>
+
+struct rw_semaphore {
+	pthread_rwlock_t lock;
+};
+
+#define DECLARE_RWSEM(name) \
+	struct rw_semaphore name = { PTHREAD_RWLOCK_INITIALIZER }
+
+#define init_rwsem(sem) pthread_rwlock_init(&(sem)->lock, NULL)
+#define down_read(sem)  pthread_rwlock_rdlock(&(sem)->lock)
+#define up_read(sem)    pthread_rwlock_unlock(&(sem)->lock)
+#define down_write(sem) pthread_rwlock_wrlock(&(sem)->lock)
+#define down_write_trylock(sem) (pthread_rwlock_trywrlock(&(sem)->lock) == 0)
+#define up_write(sem)   pthread_rwlock_unlock(&(sem)->lock)
+
+#endif
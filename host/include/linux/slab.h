@@ -0,0 +1,16 @@
+#ifndef __HOST_LINUX_SLAB_H_INCLUDED
+#define __HOST_LINUX_SLAB_H_INCLUDED
+
+#include <stdlib.h>
+#include <linux/types.h>
+
+#define GFP_KERNEL 0
+#define GFP_ATOMIC 0
+
+#define kmalloc(size, gfp)     malloc(size)
+#define kzalloc(size, gfp)     calloc(1, size)
+#define kcalloc(n, size, gfp)  calloc(n, size)
+#define kmalloc_array(n, size, gfp)  calloc(n, size)
+#define kfree(ptr)             free((void *) (ptr))
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef __HOST_LINUX_SPINLOCK_H_INCLUDED
+#define __HOST_LINUX_SPINLOCK_H_INCLUDED
+
+#include <pthread.h>
+
+typedef struct {
+	pthread_spinlock_t lock;
+} raw_spinlock_t;
+
+#define raw_spin_lock_init(l) pthread_spin_init(&(l)->lock, PTHREAD_PROCESS_PRIVATE)
+#define raw_spin_lock(l)      pthread_spin_lock(&(l)->lock)
+#define raw_spin_unlock(l)    pthread_spin_unlock(&(l)->lock)
+
+// There are no interrupts to mask on the host
+#define raw_spin_lock_irqsave(l, flags) \
+	do { (flags) = 0; pthread_spin_lock(&(l)->lock); } while (0)
+#define raw_spin_trylock_irqsave(l, flags) \
+	({ (flags) = 0; pthread_spin_trylock(&(l)->lock) == 0; })
+#define raw_spin_unlock_irqrestore(l, flags) \
+	do { (void) (flags); pthread_spin_unlock(&(l)->lock); } while (0)
+
+typedef raw_spinlock_t spinlock_t;
+
+#define spin_lock_init(l)                raw_spin_lock_init(l)
+#define spin_lock_irqsave(l, flags)      raw_spin_lock_irqsave(l, flags)
+#define spin_unlock_irqrestore(l, flags) raw_spin_unlock_irqrestore(l, flags)
+
+#endif
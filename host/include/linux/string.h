@@ -0,0 +1,6 @@
+#ifndef __HOST_LINUX_STRING_H_INCLUDED
+#define __HOST_LINUX_STRING_H_INCLUDED
+
+#include <string.h>
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef __HOST_LINUX_TRACEPOINT_H_INCLUDED
+#define __HOST_LINUX_TRACEPOINT_H_INCLUDED
+
+#include <linux/types.h>
+
+/*
+ * Tracepoints compile to nothing on the host: each event becomes an empty
+ * trace_<event>() that is never enabled.
+ */
+
+#define TP_PROTO(args...) args
+#define TP_ARGS(args...)  args
+
+#define DECLARE_EVENT_CLASS(name, proto, args, tstruct, assign, print)
+
+#define DEFINE_EVENT(template, name, proto, args) \
+	static inline void trace_##name(proto) { } \
+	static inline bool trace_##name##_enabled(void) { return false; }
+
+#define TRACE_EVENT(name, proto, args, tstruct, assign, print) \
+	DEFINE_EVENT(name, name, TP_PROTO(proto), TP_ARGS(args))
+
+#endif
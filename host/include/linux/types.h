@@ -0,0 +1,44 @@
+#ifndef __HOST_LINUX_TYPES_H_INCLUDED
+#define __HOST_LINUX_TYPES_H_INCLUDED
+
+/*
+ * Userspace stand-ins for the kernel headers mmio_core.c uses, so the core
+ * can be built and profiled on the host. See host/README.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+typedef uint8_t  u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef unsigned long long u64;
+typedef int8_t   s8;
+typedef int16_t  s16;
+typedef int32_t  s32;
+typedef long long s64;
+
+typedef uint8_t  __u8;
+typedef uint16_t __u16;
+typedef uint32_t __u32;
+typedef unsigned long long __u64;
+typedef int32_t  __s32;
+
+typedef u64 phys_addr_t;
+typedef unsigned int gfp_t;
+typedef unsigned short umode_t;
+
+#if defined(__LP64__) && !defined(CONFIG_64BIT)
+#define CONFIG_64BIT 1
+#endif
+
+#define __iomem
+#define __percpu
+#define __force
+#define __user
+#define __init
+#define __exit
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef __HOST_LINUX_WORKQUEUE_H_INCLUDED
+#define __HOST_LINUX_WORKQUEUE_H_INCLUDED
+
+// The watcher's polling work never runs on the host, see host/mmio_host.c
+struct delayed_work {
+	int unused;
+};
+
+#endif
@@ -0,0 +1 @@
+// Empty; mmio_core.c has always included this without using it
@@ -0,0 +1 @@
+// Nothing to define on the host, see linux/tracepoint.h
@@ -0,0 +1,317 @@
+/*
+ * MMIO host runtime
+ *
+ * Copyright (C) 2014 Joe Balough <jbb5044@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * The pieces of the kernel that mmio_core.c calls into, implemented in
+ * userspace: a minimal driver model that remembers each device's attributes,
+ * and stand-ins for the character device and the change watcher, which are
+ * not part of the host build. The watcher is only allocated, so that
+ * mmio_cond.c has somewhere to keep the conditions; nothing is polled or
+ * notified.
+ */
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <linux/kernel.h>
+#include <linux/device.h>
+#include <linux/err.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/overflow.h>
+#include "../mmio_watch.h"
+#include "mmio_host.h"
+
+bool mmio_host_verbose;
+
+struct mmio_host_attr {
+	struct device            *dev;
+	struct device_attribute  *attr;
+};
+
+static pthread_mutex_t mmio_host_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct mmio_host_attr *mmio_host_attrs;
+static unsigned int mmio_host_num_attrs, mmio_host_max_attrs;
+static dev_t mmio_host_next_devt;
+
+static int mmio_host_add_attr(struct device *dev, struct device_attribute *attr)
+{
+	struct mmio_host_attr *attrs;
+	int ret = 0;
+
+	pthread_mutex_lock(&mmio_host_lock);
+	if (mmio_host_num_attrs == mmio_host_max_attrs)
+	{
+		attrs = realloc(mmio_host_attrs, (mmio_host_max_attrs * 2 + 16) * sizeof(*attrs));
+		if (!attrs)
+		{
+			ret = -ENOMEM;
+			goto out;
+		}
+		mmio_host_attrs = attrs;
+		mmio_host_max_attrs = mmio_host_max_attrs * 2 + 16;
+	}
+	mmio_host_attrs[mmio_host_num_attrs].dev = dev;
+	mmio_host_attrs[mmio_host_num_attrs].attr = attr;
+	mmio_host_num_attrs++;
+
+	out:
+	pthread_mutex_unlock(&mmio_host_lock);
+	return ret;
+}
+
+/**
+ * mmio_host_del_attrs - Forget a device's attributes
+ * @dev  The device
+ * @attr The attribute to forget, or NULL for all of them
+ */
+static void mmio_host_del_attrs(struct device *dev, const struct device_attribute *attr)
+{
+	unsigned int i = 0;
+
+	pthread_mutex_lock(&mmio_host_lock);
+	while (i < mmio_host_num_attrs)
+	{
+		if (mmio_host_attrs[i].dev == dev && (!attr || mmio_host_attrs[i].attr == attr))
+			mmio_host_attrs[i] = mmio_host_attrs[--mmio_host_num_attrs];
+		else
+			i++;
+	}
+	pthread_mutex_unlock(&mmio_host_lock);
+}
+
+struct device_attribute *mmio_host_find_attr(struct device *dev, const char *name)
+{
+	struct device_attribute *attr = NULL;
+	unsigned int i;
+
+	pthread_mutex_lock(&mmio_host_lock);
+	for (i = 0; i < mmio_host_num_attrs; i++)
+	{
+		if (mmio_host_attrs[i].dev == dev && !strcmp(mmio_host_attrs[i].attr->attr.name, name))
+		{
+			attr = mmio_host_attrs[i].attr;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&mmio_host_lock);
+	return attr;
+}
+
+struct class *class_create(const char *name)
+{
+	struct class *cls = kzalloc(sizeof(*cls), GFP_KERNEL);
+
+	if (!cls)
+		return ERR_PTR(-ENOMEM);
+	cls->name = name;
+	return cls;
+}
+
+void class_destroy(struct class *cls)
+{
+	kfree(cls);
+}
+
+struct device *device_create(struct class *cls, struct device *parent, dev_t devt,
+							 void *drvdata, const char *fmt, ...)
+{
+	struct device *dev = kzalloc(sizeof(*dev), GFP_KERNEL);
+	va_list args;
+
+	if (!dev)
+		return ERR_PTR(-ENOMEM);
+
+	va_start(args, fmt);
+	vsnprintf(dev->name, sizeof(dev->name), fmt, args);
+	va_end(args);
+
+	dev->kobj.name = dev->name;
+	dev->driver_data = drvdata;
+	return dev;
+}
+
+void device_unregister(struct device *dev)
+{
+	mmio_host_del_attrs(dev, NULL);
+	kfree(dev);
+}
+
+int device_create_file(struct device *dev, const struct device_attribute *attr)
+{
+	return mmio_host_add_attr(dev, (struct device_attribute *) attr);
+}
+
+void device_remove_file(struct device *dev, const struct device_attribute *attr)
+{
+	mmio_host_del_attrs(dev, attr);
+}
+
+int sysfs_create_group(struct kobject *kobj, const struct attribute_group *grp)
+{
+	struct device *dev = kobj_to_dev(kobj);
+	struct attribute *attr;
+	int i, ret;
+
+	for (i = 0; (attr = grp->attrs[i]); i++)
+	{
+		if (grp->is_visible && !grp->is_visible(kobj, attr, i))
+			continue;
+		ret = mmio_host_add_attr(dev, container_of(attr, struct device_attribute, attr));
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+void sysfs_remove_group(struct kobject *kobj, const struct attribute_group *grp)
+{
+	struct device *dev = kobj_to_dev(kobj);
+	int i;
+
+	for (i = 0; grp->attrs[i]; i++)
+		mmio_host_del_attrs(dev, container_of(grp->attrs[i], struct device_attribute, attr));
+}
+
+int mmio_cdev_init(void)
+{
+	return 0;
+}
+
+void mmio_cdev_exit(void)
+{
+}
+
+int mmio_cdev_add(struct mmio_classdev *mmio_cdev, dev_t *devt)
+{
+	pthread_mutex_lock(&mmio_host_lock);
+	*devt = mmio_host_next_devt++;
+	pthread_mutex_unlock(&mmio_host_lock);
+
+	return 0;
+}
+
+void mmio_cdev_attach(struct mmio_classdev *mmio_cdev)
+{
+}
+
+void mmio_cdev_del(struct mmio_classdev *mmio_cdev)
+{
+}
+
+// No debugfs on the host, but keep the counters so the stats paths can run
+void mmio_debugfs_init(void)
+{
+}
+
+void mmio_debugfs_exit(void)
+{
+}
+
+int mmio_debugfs_add(struct mmio_classdev *mmio_cdev)
+{
+	mmio_cdev->stats = alloc_percpu(struct mmio_stats);
+	return mmio_cdev->stats ? 0 : -ENOMEM;
+}
+
+void mmio_debugfs_del(struct mmio_classdev *mmio_cdev)
+{
+	free_percpu(mmio_cdev->stats);
+	mmio_cdev->stats = NULL;
+}
+
+// Nothing is watched on the host, but conditions can be set and fed values
+int mmio_watch_add(struct mmio_classdev *mmio_cdev)
+{
+	struct mmio_watcher *w;
+
+	w = kzalloc(struct_size(w, entries, mmio_cdev->num_entries), GFP_KERNEL);
+	if (!w)
+		return -ENOMEM;
+	w->mmio_cdev = mmio_cdev;
+	spin_lock_init(&w->cond_lock);
+	mmio_cdev->watcher = w;
+	return 0;
+}
+
+void mmio_watch_del(struct mmio_classdev *mmio_cdev)
+{
+	struct mmio_watcher *w = mmio_cdev->watcher;
+	unsigned int i;
+
+	for (i = 0; i < mmio_cdev->num_entries; i++)
+	{
+		if (w->entries[i].cond)
+			static_branch_dec(&mmio_notify_key);
+		kfree(w->entries[i].cond);
+	}
+
+	mmio_cdev->watcher = NULL;
+	kfree(w);
+}
+
+struct mmio_host_write mmio_host_writes[MMIO_HOST_WRITES];
+unsigned int mmio_host_num_writes;
+
+void mmio_notify_write(struct mmio_classdev *mmio_cdev, struct mmio_entry *entry,
+					   u64 old, u64 value)
+{
+	if (mmio_host_num_writes < MMIO_HOST_WRITES)
+		mmio_host_writes[mmio_host_num_writes] = (struct mmio_host_write) { entry, old, value };
+	mmio_host_num_writes++;
+}
+
+ssize_t mmio_watch_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	return 0;
+}
+
+ssize_t mmio_watch_store(struct device *dev, struct device_attribute *attr,
+						 const char *buf, size_t size)
+{
+	return -ENODEV;
+}
+
+ssize_t mmio_wait_store(struct device *dev, struct device_attribute *attr,
+						const char *buf, size_t size)
+{
+	return -ENODEV;
+}
+
+int mmio_host_init(void)
+{
+	mmio_host_verbose = getenv("MMIO_HOST_VERBOSE") != NULL;
+	if (getenv("MMIO_HOST_STATS"))
+		static_branch_enable(&mmio_stats_key);
+	return mmio_host_initcall();
+}
+
+void mmio_host_exit(void)
+{
+	mmio_host_exitcall();
+	free(mmio_host_attrs);
+	mmio_host_attrs = NULL;
+	mmio_host_num_attrs = mmio_host_max_attrs = 0;
+}
+
+ssize_t mmio_host_show(struct mmio_classdev *mmio_cdev, const char *name, char *buf)
+{
+	struct device_attribute *attr = mmio_host_find_attr(mmio_cdev->dev, name);
+
+	if (!attr || !attr->show)
+		return -ENOENT;
+	return attr->show(mmio_cdev->dev, attr, buf);
+}
+
+ssize_t mmio_host_store(struct mmio_classdev *mmio_cdev, const char *name, const char *buf)
+{
+	struct device_attribute *attr = mmio_host_find_attr(mmio_cdev->dev, name);
+
+	if (!attr || !attr->store)
+		return -ENOENT;
+	return attr->store(mmio_cdev->dev, attr, buf, strlen(buf));
+}
@@ -0,0 +1,24 @@
+#ifndef __MMIO_HOST_H_INCLUDED
+#define __MMIO_HOST_H_INCLUDED
+
+#include "../mmio.h"
+
+// Runs mmio_core.c's initcall; call before registering any bank
+extern int  mmio_host_init(void);
+extern void mmio_host_exit(void);
+
+// Call a bank attribute's show or store handler by its sysfs file name
+extern ssize_t mmio_host_show(struct mmio_classdev *mmio_cdev, const char *name, char *buf);
+extern ssize_t mmio_host_store(struct mmio_classdev *mmio_cdev, const char *name, const char *buf);
+
+// The first writes notified while mmio_notify_key is on, and how many there were
+#define MMIO_HOST_WRITES 8
+struct mmio_host_write {
+	struct mmio_entry *entry;
+	u64               old;
+	u64               value;
+};
+extern struct mmio_host_write mmio_host_writes[MMIO_HOST_WRITES];
+extern unsigned int mmio_host_num_writes;
+
+#endif
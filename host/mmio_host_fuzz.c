@@ -0,0 +1,179 @@
+/*
+ * MMIO host fuzz target
+ *
+ * Copyright (C) 2014 Joe Balough <jbb5044@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * A libFuzzer target. The first bytes of the input describe a bank (flags,
+ * register size and one entry's mask); the rest is a stream of operations on
+ * it, checked against a model of the register kept here. Built without
+ * libFuzzer, main() runs each file named on the command line once.
+ */
+
+#include <linux/kernel.h>
+#include "mmio_host.h"
+
+enum {
+	FUZZ_GET,
+	FUZZ_SET,
+	FUZZ_STORE,
+	FUZZ_COMMIT,
+	FUZZ_ABORT,
+	FUZZ_SYNC,
+	FUZZ_NUM_OPS,
+};
+
+static u64 fuzz_mem[4] __attribute__((aligned(8)));
+
+static bool fuzz_take(const u8 **data, size_t *len, void *out, size_t n)
+{
+	if (*len < n)
+		return false;
+	memcpy(out, *data, n);
+	*data += n;
+	*len -= n;
+	return true;
+}
+
+static u64 fuzz_reg(u8 size)
+{
+	switch (size)
+	{
+		case 1:  return *(u8 *) fuzz_mem;
+		case 2:  return *(u16 *) fuzz_mem;
+		case 4:  return *(u32 *) fuzz_mem;
+		default: return fuzz_mem[0];
+	}
+}
+
+int LLVMFuzzerTestOneInput(const u8 *data, size_t len)
+{
+	static bool initialized;
+	struct mmio_entry entry = { .name = "field", .flags = MMIO_ENTRY_RW };
+	struct mmio_classdev bank = { .name = "fuzz", .entries = &entry, .num_entries = 1 };
+	u64 value, field, reg, staged_mask = 0, staged_value = 0, width_mask;
+	bool fits;
+	char buf[32];
+	u8 hdr, op;
+	int len_str;
+
+	if (!initialized)
+	{
+		if (mmio_host_init())
+			abort();
+		initialized = true;
+	}
+
+	if (!fuzz_take(&data, &len, &hdr, 1) || !fuzz_take(&data, &len, &entry.mask, 8))
+		return 0;
+
+	memset(fuzz_mem, 0, sizeof(fuzz_mem));
+	bank.base = fuzz_mem;
+	bank.size = 1 << (hdr & 3);
+	bank.flags = (hdr >> 2) & (MMIO_BANK_STAGED | MMIO_BANK_CACHED);
+	width_mask = bank.size == 8 ? ~0ULL : (1ULL << (bank.size * 8)) - 1;
+
+	if (mmio_classdev_register(NULL, &bank))
+	{
+		// Only masks wider than the register are rejected
+		if (!(entry.mask & ~width_mask))
+			abort();
+		return 0;
+	}
+	if (!entry.mask)
+		goto out;
+
+	while (fuzz_take(&data, &len, &op, 1) && fuzz_take(&data, &len, &value, 8))
+	{
+		field = value << entry.shift;
+		fits = value <= entry.max && !(field & ~entry.mask);
+		reg = fuzz_reg(bank.size);
+
+		switch (op % FUZZ_NUM_OPS)
+		{
+			case FUZZ_GET:
+				if (mmio_get_value(&bank, &entry) != (reg & entry.mask) >> entry.shift)
+					abort();
+				break;
+
+			case FUZZ_SET:
+				if (mmio_set_value(&bank, &entry, value) == 0)
+				{
+					if (!fits || fuzz_reg(bank.size) != ((reg & ~entry.mask) | field))
+						abort();
+				}
+				else if (fits || fuzz_reg(bank.size) != reg)
+				{
+					abort();
+				}
+				break;
+
+			case FUZZ_STORE:
+				len_str = snprintf(buf, sizeof(buf), (op & 0x80) ? "%llu\n" : "%llu", value);
+				if (mmio_host_store(&bank, "field", buf) == len_str && fits)
+				{
+					if (bank.flags & MMIO_BANK_STAGED)
+					{
+						staged_mask = entry.mask;
+						staged_value = field;
+					}
+					else if (fuzz_reg(bank.size) != ((reg & ~entry.mask) | field))
+					{
+						abort();
+					}
+				}
+				else if (fits)
+				{
+					abort();
+				}
+				break;
+
+			case FUZZ_COMMIT:
+				mmio_commit(&bank);
+				if (staged_mask && fuzz_reg(bank.size) != ((reg & ~staged_mask) | staged_value))
+					abort();
+				staged_mask = staged_value = 0;
+				break;
+
+			case FUZZ_ABORT:
+				mmio_abort(&bank);
+				staged_mask = staged_value = 0;
+				break;
+
+			case FUZZ_SYNC:
+				mmio_sync(&bank);
+				break;
+		}
+	}
+
+	out:
+	mmio_classdev_unregister(&bank);
+	return 0;
+}
+
+#ifndef MMIO_HOST_LIBFUZZER
+int main(int argc, char **argv)
+{
+	static u8 input[1 << 16];
+	size_t len;
+	FILE *f;
+	int i;
+
+	for (i = 1; i < argc; i++)
+	{
+		f = fopen(argv[i], "rb");
+		if (!f)
+		{
+			perror(argv[i]);
+			return 1;
+		}
+		len = fread(input, 1, sizeof(input), f);
+		fclose(f);
+		LLVMFuzzerTestOneInput(input, len);
+	}
+	return 0;
+}
+#endif
@@ -0,0 +1,771 @@
+/*
+ * MMIO host tests and benchmarks
+ *
+ * Copyright (C) 2014 Joe Balough <jbb5044@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Usage: mmio_host [test]
+ *        mmio_host bench [iterations] [readers]
+ *
+ * "test" checks registration, field extraction, the read-modify-write, store
+ * parsing, staging, the shadow cache, bank dumps and notification conditions
+ * against banks backed by plain memory, and round-trips the compressed sample
+ * encoder through tools/mmio_decode.h.
+ * "bench" prints the same key=value lines as the mmio_bench KUnit suite.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <linux/kernel.h>
+#include "../mmio_watch.h"
+#include "mmio_host.h"
+#include "../tools/mmio_decode.h"
+
+static int failures;
+
+#define CHECK(cond) \
+	do { if (!(cond)) { failures++; \
+		fprintf(stderr, "%s:%d: %s: check failed: %s\n", __FILE__, __LINE__, __func__, #cond); } \
+	} while (0)
+
+#define CHECK_EQ(a, b) \
+	do { unsigned long long _a = (a), _b = (b); if (_a != _b) { failures++; \
+		fprintf(stderr, "%s:%d: %s: %s == %s failed: 0x%llx != 0x%llx\n", \
+				__FILE__, __LINE__, __func__, #a, #b, _a, _b); } \
+	} while (0)
+
+static u64 mmio_host_mem[64] __attribute__((aligned(64)));
+
+static void mmio_host_bank(struct mmio_classdev *mmio_cdev, const char *name, u8 size,
+						   struct mmio_entry *entries, unsigned int num_entries)
+{
+	memset(mmio_cdev, 0, sizeof(*mmio_cdev));
+	memset(mmio_host_mem, 0, sizeof(mmio_host_mem));
+	mmio_cdev->name = name;
+	mmio_cdev->size = size;
+	mmio_cdev->entries = entries;
+	mmio_cdev->num_entries = num_entries;
+	mmio_cdev->base = mmio_host_mem;
+}
+
+static void test_register_validation(void)
+{
+	struct mmio_entry wide[] = { { .name = "wide", .mask = 0x1ff, .flags = MMIO_ENTRY_RW } };
+	struct mmio_entry unaligned[] = { { .name = "odd", .mask = 0xff, .flags = MMIO_ENTRY_RW, .offset = 2 } };
+	struct mmio_entry mixed[] = {
+		{ .name = "a", .mask = 0xff, .flags = MMIO_ENTRY_RW, .offset = 0, .size = 4 },
+		{ .name = "b", .mask = 0xff, .flags = MMIO_ENTRY_RW, .offset = 0, .size = 2 },
+	};
+	struct mmio_entry overlap[] = {
+		{ .name = "word", .mask = 0xff, .flags = MMIO_ENTRY_RW, .offset = 0, .size = 4 },
+		{ .name = "half", .mask = 0xff, .flags = MMIO_ENTRY_RW, .offset = 2, .size = 2 },
+	};
+	struct mmio_entry wide_overlap[] = {
+		{ .name = "low",  .mask = 0xff, .flags = MMIO_ENTRY_RW, .offset = 4 },
+		{ .name = "wide", .mask = 0xff, .flags = MMIO_ENTRY_RW, .offset = 0, .size = 8 },
+	};
+	struct mmio_entry reserved[] = { { .name = "wait", .mask = 0xff, .flags = MMIO_ENTRY_RW } };
+	struct mmio_entry ok[] = { { .name = "ok", .mask = 0xff, .flags = MMIO_ENTRY_RW } };
+	struct mmio_classdev bank;
+
+	mmio_host_bank(&bank, "bad_size", 3, ok, ARRAY_SIZE(ok));
+	CHECK_EQ(mmio_classdev_register(NULL, &bank), -EINVAL);
+
+	mmio_host_bank(&bank, "no_base", 4, ok, ARRAY_SIZE(ok));
+	bank.base = NULL;
+	CHECK_EQ(mmio_classdev_register(NULL, &bank), -EINVAL);
+
+	mmio_host_bank(&bank, "wide", 1, wide, ARRAY_SIZE(wide));
+	CHECK_EQ(mmio_classdev_register(NULL, &bank), -EINVAL);
+
+	mmio_host_bank(&bank, "unaligned", 4, unaligned, ARRAY_SIZE(unaligned));
+	CHECK_EQ(mmio_classdev_register(NULL, &bank), -EINVAL);
+
+	mmio_host_bank(&bank, "mixed", 4, mixed, ARRAY_SIZE(mixed));
+	CHECK_EQ(mmio_classdev_register(NULL, &bank), -EINVAL);
+	CHECK(bank.regs == NULL);
+
+	// Registers at different offsets may not share bytes, in either order
+	mmio_host_bank(&bank, "overlap", 4, overlap, ARRAY_SIZE(overlap));
+	CHECK_EQ(mmio_classdev_register(NULL, &bank), -EINVAL);
+	mmio_host_bank(&bank, "wide_overlap", 4, wide_overlap, ARRAY_SIZE(wide_overlap));
+	CHECK_EQ(mmio_classdev_register(NULL, &bank), -EINVAL);
+
+	// Named like a bank attribute
+	mmio_host_bank(&bank, "reserved", 4, reserved, ARRAY_SIZE(reserved));
+	CHECK_EQ(mmio_classdev_register(NULL, &bank), -EINVAL);
+
+	mmio_host_bank(&bank, "ok", 4, ok, ARRAY_SIZE(ok));
+	CHECK_EQ(mmio_classdev_register(NULL, &bank), 0);
+	CHECK_EQ(bank.num_regs, 1);
+	mmio_classdev_unregister(&bank);
+	CHECK(bank.regs == NULL);
+}
+
+static void test_get_set(void)
+{
+	struct mmio_entry entries[] = {
+		{ .name = "low",  .mask = 0x000000ff, .flags = MMIO_ENTRY_RW },
+		{ .name = "mid",  .mask = 0x0000ff00, .flags = MMIO_ENTRY_RW },
+		{ .name = "high", .mask = 0xffff0000, .flags = MMIO_ENTRY_RW },
+		{ .name = "gaps", .mask = 0x00000505, .flags = MMIO_ENTRY_RW },
+	};
+	struct mmio_classdev bank;
+	u32 *reg = (u32 *) mmio_host_mem;
+
+	mmio_host_bank(&bank, "get_set", 4, entries, ARRAY_SIZE(entries));
+	CHECK_EQ(mmio_classdev_register(NULL, &bank), 0);
+
+	*reg = 0x12345678;
+	CHECK_EQ(mmio_get_value(&bank, &entries[0]), 0x78);
+	CHECK_EQ(mmio_get_value(&bank, &entries[1]), 0x56);
+	CHECK_EQ(mmio_get_value(&bank, &entries[2]), 0x1234);
+
+	CHECK_EQ(mmio_set_value(&bank, &entries[1], 0xab), 0);
+	CHECK_EQ(*reg, 0x1234ab78);
+	CHECK_EQ(mmio_set_value(&bank, &entries[1], 0x100), -EOVERFLOW);
+	CHECK_EQ(*reg, 0x1234ab78);
+	CHECK_EQ(mmio_set_value(&bank, &entries[2], 0xffff), 0);
+	CHECK_EQ(*reg, 0xffffab78);
+
+	// Values may not reach into the gaps of a mask
+	CHECK_EQ(mmio_set_value(&bank, &entries[3], 0x2), -EOVERFLOW);
+	CHECK_EQ(mmio_set_value(&bank, &entries[3], 0x101), 0);
+	CHECK_EQ(*reg, 0xffffab79);
+
+	mmio_classdev_unregister(&bank);
+}
+
+static void test_block_and_64bit(void)
+{
+	struct mmio_entry entries[] = {
+		{ .name = "ctrl",  .mask = 0x0f,  .flags = MMIO_ENTRY_RW, .offset = 0x00 },
+		{ .name = "level", .mask = 0xf0,  .flags = MMIO_ENTRY_RW, .offset = 0x04, .size = 1 },
+		{ .name = "stamp", .mask = ~0ULL, .flags = MMIO_ENTRY_RW, .offset = 0x08, .size = 8 },
+	};
+	struct mmio_classdev bank;
+
+	mmio_host_bank(&bank, "block", 4, entries, ARRAY_SIZE(entries));
+	CHECK_EQ(mmio_classdev_register(NULL, &bank), 0);
+	CHECK_EQ(bank.num_regs, 3);
+	CHECK_EQ(bank.span, 16);
+
+	CHECK_EQ(mmio_set_value(&bank, &entries[1], 0xa), 0);
+	CHECK_EQ(((u8 *) mmio_host_mem)[4], 0xa0);
+	CHECK_EQ(mmio_set_value(&bank, &entries[2], 0x0123456789abcdefULL), 0);
+	CHECK_EQ(mmio_host_mem[1], 0x0123456789abcdefULL);
+	CHECK_EQ(mmio_get_value(&bank, &entries[2]), 0x0123456789abcdefULL);
+	CHECK_EQ(mmio_get_value(&bank, &entries[0]), 0);
+
+	mmio_classdev_unregister(&bank);
+}
+
+static void test_store_parsing(void)
+{
+	struct mmio_entry entries[] = {
+		{ .name = "value", .mask = 0xff00, .flags = MMIO_ENTRY_RW },
+		{ .name = "ro",    .mask = 0x00ff, .flags = MMIO_ENTRY_READ },
+	};
+	struct mmio_classdev bank;
+	char buf[64];
+
+	mmio_host_bank(&bank, "store", 2, entries, ARRAY_SIZE(entries));
+	CHECK_EQ(mmio_classdev_register(NULL, &bank), 0);
+
+	CHECK_EQ(mmio_host_store(&bank, "value", "42\n"), 3);
+	CHECK_EQ(mmio_host_store(&bank, "value", "7"), 1);
+	CHECK_EQ(mmio_host_show(&bank, "value", buf), 2);
+	CHECK(!strcmp(buf, "7\n"));
+
+	CHECK_EQ(mmio_host_store(&bank, "value", "42x"), -EINVAL);
+	CHECK_EQ(mmio_host_store(&bank, "value", " 42"), -EINVAL);
+	CHECK_EQ(mmio_host_store(&bank, "value", "4 2"), -EINVAL);
+	CHECK_EQ(mmio_host_store(&bank, "value", "256"), -EOVERFLOW);
+	CHECK_EQ(mmio_host_store(&bank, "ro", "1"), -EPERM);
+	CHECK_EQ(*(u16 *) mmio_host_mem, 0x0700);
+
+	// Bank attributes only appear on banks that use them
+	CHECK_EQ(mmio_host_store(&bank, "commit", "1"), -ENOENT);
+	CHECK_EQ(mmio_host_store(&bank, "sync", "1"), -ENOENT);
+
+	mmio_classdev_unregister(&bank);
+}
+
+static void test_staged(void)
+{
+	struct mmio_entry entries[] = {
+		{ .name = "a", .mask = 0x0f, .flags = MMIO_ENTRY_RW },
+		{ .name = "b", .mask = 0xf0, .flags = MMIO_ENTRY_RW },
+	};
+	struct mmio_classdev bank;
+
+	mmio_host_bank(&bank, "staged", 1, entries, ARRAY_SIZE(entries));
+	bank.flags = MMIO_BANK_STAGED;
+	CHECK_EQ(mmio_classdev_register(NULL, &bank), 0);
+
+	CHECK_EQ(mmio_host_store(&bank, "a", "3"), 1);
+	CHECK_EQ(mmio_host_store(&bank, "b", "5"), 1);
+	CHECK_EQ(*(u8 *) mmio_host_mem, 0);
+	static_branch_inc(&mmio_notify_key);
+	mmio_host_num_writes = 0;
+	CHECK_EQ(mmio_host_store(&bank, "commit", "1"), 1);
+	static_branch_dec(&mmio_notify_key);
+	CHECK_EQ(*(u8 *) mmio_host_mem, 0x53);
+
+	// Committed writes are notified like any other
+	CHECK_EQ(mmio_host_num_writes, 2);
+	CHECK(mmio_host_writes[0].entry == &entries[0]);
+	CHECK_EQ(mmio_host_writes[0].old, 0);
+	CHECK_EQ(mmio_host_writes[0].value, 3);
+	CHECK(mmio_host_writes[1].entry == &entries[1]);
+	CHECK_EQ(mmio_host_writes[1].value, 5);
+
+	CHECK_EQ(mmio_host_store(&bank, "a", "9"), 1);
+	CHECK_EQ(mmio_host_store(&bank, "abort", "1"), 1);
+	CHECK_EQ(mmio_host_store(&bank, "commit", "1"), 1);
+	CHECK_EQ(*(u8 *) mmio_host_mem, 0x53);
+
+	mmio_classdev_unregister(&bank);
+}
+
+static void test_cached(void)
+{
+	struct mmio_entry entries[] = {
+		{ .name = "field", .mask = 0xff, .flags = MMIO_ENTRY_RW },
+		{ .name = "live",  .mask = 0xff, .flags = MMIO_ENTRY_RW | MMIO_ENTRY_VOLATILE },
+	};
+	struct mmio_classdev bank;
+	u32 *reg = (u32 *) mmio_host_mem;
+
+	mmio_host_bank(&bank, "cached", 4, entries, ARRAY_SIZE(entries));
+	bank.flags = MMIO_BANK_CACHED;
+	CHECK_EQ(mmio_classdev_register(NULL, &bank), 0);
+
+	*reg = 0x11;
+	CHECK_EQ(mmio_get_value(&bank, &entries[0]), 0x11);
+	*reg = 0x22;
+	CHECK_EQ(mmio_get_value(&bank, &entries[0]), 0x11);
+	CHECK_EQ(mmio_get_value(&bank, &entries[1]), 0x22);
+	CHECK_EQ(mmio_host_store(&bank, "sync", "1"), 1);
+	CHECK_EQ(mmio_get_value(&bank, &entries[0]), 0x22);
+
+	*reg = 0x33;
+	mmio_invalidate(&bank);
+	CHECK_EQ(mmio_get_value(&bank, &entries[0]), 0x33);
+
+	mmio_classdev_unregister(&bank);
+}
+
+static unsigned int dump_reads;
+
+static u64 dump_read(struct mmio_classdev *mmio_cdev, struct mmio_reg *reg)
+{
+	dump_reads++;
+	return *(u32 *) reg->addr;
+}
+
+static void dump_write(struct mmio_classdev *mmio_cdev, struct mmio_reg *reg, u64 val)
+{
+	*(u32 *) reg->addr = val;
+}
+
+static void test_dump(void)
+{
+	static const struct mmio_bus_ops ops = { .read = dump_read, .write = dump_write };
+	struct mmio_entry entries[] = {
+		{ .name = "a",    .mask = 0x0000ffff, .flags = MMIO_ENTRY_RW },
+		{ .name = "b",    .mask = 0xffff0000, .flags = MMIO_ENTRY_READ },
+		{ .name = "wo",   .mask = 0x000000ff, .flags = MMIO_ENTRY_WRITE, .offset = 4 },
+		{ .name = "c",    .mask = 0x000000f0, .flags = MMIO_ENTRY_RW, .offset = 8 },
+	};
+	struct mmio_classdev bank;
+	u32 *reg = (u32 *) mmio_host_mem;
+	char buf[PAGE_SIZE];
+	u64 values[4];
+
+	mmio_host_bank(&bank, "dump", 4, entries, ARRAY_SIZE(entries));
+	bank.ops = &ops;
+	CHECK_EQ(mmio_classdev_register(NULL, &bank), 0);
+
+	reg[0] = 0x12345678;
+	reg[1] = 0xff;
+	reg[2] = 0xa5;
+
+	// Registers without a readable entry aren't touched
+	dump_reads = 0;
+	CHECK_EQ(mmio_get_values(&bank, 0, 4, values), 0);
+	CHECK_EQ(dump_reads, 2);
+	CHECK_EQ(values[0], 0x5678);
+	CHECK_EQ(values[1], 0x1234);
+	CHECK_EQ(values[2], 0);
+	CHECK_EQ(values[3], 0xa);
+
+	dump_reads = 0;
+	CHECK_EQ(mmio_get_values(&bank, 1, 2, values), 0);
+	CHECK_EQ(dump_reads, 1);
+	CHECK_EQ(values[0], 0x1234);
+	CHECK_EQ(mmio_get_values(&bank, 3, 2, values), -EINVAL);
+
+	CHECK(mmio_host_show(&bank, "dump", buf) > 0);
+	CHECK(!strcmp(buf, "a=22136\nb=4660\nc=10\n"));
+
+	mmio_classdev_unregister(&bank);
+}
+
+static u64 mmio_hist_sum(const u64 *hist)
+{
+	u64 sum = 0;
+	int b;
+
+	for (b = 0; b < MMIO_HIST_BUCKETS; b++)
+		sum += hist[b];
+	return sum;
+}
+
+static void test_stats(void)
+{
+	struct mmio_entry entries[] = {
+		{ .name = "field", .mask = 0xf0, .flags = MMIO_ENTRY_RW },
+	};
+	struct mmio_classdev bank;
+	bool was_enabled = static_key_enabled(&mmio_stats_key);
+
+	mmio_host_bank(&bank, "stats", 4, entries, ARRAY_SIZE(entries));
+	CHECK_EQ(mmio_classdev_register(NULL, &bank), 0);
+
+	static_branch_disable(&mmio_stats_key);
+	mmio_get_value(&bank, &entries[0]);
+	CHECK_EQ(bank.stats->reads, 0);
+
+	static_branch_enable(&mmio_stats_key);
+	mmio_get_value(&bank, &entries[0]);
+	mmio_get_value(&bank, &entries[0]);
+	CHECK_EQ(mmio_set_value(&bank, &entries[0], 3), 0);
+	CHECK_EQ(mmio_set_value(&bank, &entries[0], 16), -EOVERFLOW);
+	CHECK_EQ(bank.stats->reads, 2);
+	CHECK_EQ(bank.stats->writes, 1);
+	CHECK_EQ(bank.stats->overflows, 1);
+	CHECK_EQ(bank.stats->bus_reads, 3);
+	CHECK_EQ(bank.stats->bus_writes, 1);
+	CHECK_EQ(bank.stats->contentions, 0);
+	CHECK_EQ(mmio_hist_sum(bank.stats->read_hist), 3);
+	CHECK_EQ(mmio_hist_sum(bank.stats->write_hist), 1);
+
+	if (!was_enabled)
+		static_branch_disable(&mmio_stats_key);
+	mmio_classdev_unregister(&bank);
+}
+
+// Feed the values to an entry's condition, one bit per notification in the result
+static unsigned int cond_feed(struct mmio_watcher *w, unsigned int i, u64 *last,
+							  const u64 *values, unsigned int n)
+{
+	unsigned int j, notified = 0;
+
+	for (j = 0; j < n; j++)
+	{
+		if (mmio_cond_notify(w, i, *last, values[j]))
+			notified |= 1U << j;
+		*last = values[j];
+	}
+	return notified;
+}
+
+static void test_conditions(void)
+{
+	struct mmio_entry entries[] = {
+		{ .name = "level",  .mask = 0x00ff, .flags = MMIO_ENTRY_RW },
+		{ .name = "status", .mask = 0xff00, .flags = MMIO_ENTRY_RW },
+		{ .name = "wo",     .mask = 0x00ff, .flags = MMIO_ENTRY_WRITE, .offset = 4 },
+	};
+	// Met above 10, unmet again at 7 and below
+	static const u64 above[] = { 5, 11, 12, 8, 11, 7, 11 };
+	// Met below 10, unmet again at 13 and above
+	static const u64 below[] = { 5, 12, 13, 9 };
+	// Against the value 3 observations back, after the initial 0
+	static const u64 rate[] = { 1, 2, 4, 6, 7, 7, 1 };
+	static const u64 mask[] = { 0x5, 0x6, 0x1, 0x3 };
+	struct mmio_condition cond;
+	struct mmio_classdev bank;
+	struct mmio_watcher *w;
+	bool notifying = static_key_enabled(&mmio_notify_key);
+	char buf[PAGE_SIZE];
+	u64 last;
+
+	mmio_host_bank(&bank, "cond", 4, entries, ARRAY_SIZE(entries));
+	CHECK_EQ(mmio_classdev_register(NULL, &bank), 0);
+	w = bank.watcher;
+
+	// Without a condition, every change is notified
+	CHECK(mmio_cond_notify(w, 0, 1, 2));
+	CHECK(!mmio_cond_notify(w, 0, 2, 2));
+
+	cond = (struct mmio_condition) { .type = MMIO_COND_ABOVE, .threshold = 10, .hysteresis = 3 };
+	CHECK_EQ(mmio_watch_condition(&bank, &entries[0], &cond), 0);
+	CHECK(static_key_enabled(&mmio_notify_key));
+	last = 0;
+	CHECK_EQ(cond_feed(w, 0, &last, above, ARRAY_SIZE(above)), 0x42);
+
+	// The entry reads 0, so the condition starts out met
+	cond = (struct mmio_condition) { .type = MMIO_COND_BELOW, .threshold = 10, .hysteresis = 3 };
+	CHECK_EQ(mmio_watch_condition(&bank, &entries[0], &cond), 0);
+	last = 0;
+	CHECK_EQ(cond_feed(w, 0, &last, below, ARRAY_SIZE(below)), 0x8);
+
+	cond = (struct mmio_condition) { .type = MMIO_COND_RATE, .delta = 5, .samples = 3 };
+	CHECK_EQ(mmio_watch_condition(&bank, &entries[0], &cond), 0);
+	last = 0;
+	CHECK_EQ(cond_feed(w, 0, &last, rate, ARRAY_SIZE(rate)), 0x48);
+
+	cond = (struct mmio_condition) { .type = MMIO_COND_MASK, .mask = 0x3, .match = 0x1 };
+	CHECK_EQ(mmio_watch_condition(&bank, &entries[0], &cond), 0);
+	last = 0;
+	CHECK_EQ(cond_feed(w, 0, &last, mask, ARRAY_SIZE(mask)), 0x5);
+
+	CHECK_EQ(mmio_watch_condition(&bank, &entries[0], NULL), 0);
+	CHECK(mmio_cond_notify(w, 0, 1, 2));
+
+	cond = (struct mmio_condition) { .type = MMIO_COND_RATE, .delta = 5 };
+	CHECK_EQ(mmio_watch_condition(&bank, &entries[0], &cond), -EINVAL);
+	cond.samples = MMIO_COND_MAX_SAMPLES + 1;
+	CHECK_EQ(mmio_watch_condition(&bank, &entries[0], &cond), -EINVAL);
+	cond = (struct mmio_condition) { .type = MMIO_COND_MASK, .mask = 0x3, .match = 0x4 };
+	CHECK_EQ(mmio_watch_condition(&bank, &entries[0], &cond), -EINVAL);
+	cond = (struct mmio_condition) { .type = MMIO_COND_MASK + 1 };
+	CHECK_EQ(mmio_watch_condition(&bank, &entries[0], &cond), -EINVAL);
+	cond = (struct mmio_condition) { .type = MMIO_COND_ABOVE };
+	CHECK_EQ(mmio_watch_condition(&bank, &entries[2], &cond), -EPERM);
+
+	CHECK_EQ(mmio_host_store(&bank, "condition", "level above 10 3\n"), 17);
+	CHECK(mmio_host_show(&bank, "condition", buf) > 0);
+	CHECK(!strcmp(buf, "level above 10 3\n"));
+	CHECK_EQ(mmio_host_store(&bank, "condition", "level below 0x10"), 16);
+	CHECK(mmio_host_show(&bank, "condition", buf) > 0);
+	CHECK(!strcmp(buf, "level below 16 0\n"));
+	CHECK_EQ(mmio_host_store(&bank, "condition", "level rate 5 3"), 14);
+	CHECK_EQ(mmio_host_store(&bank, "condition", "status mask 0xf0 0x10"), 21);
+	CHECK(mmio_host_show(&bank, "condition", buf) > 0);
+	CHECK(!strcmp(buf, "level rate 5 3\nstatus mask 0xf0 0x10\n"));
+
+	CHECK_EQ(mmio_host_store(&bank, "condition", "level"), -EINVAL);
+	CHECK_EQ(mmio_host_store(&bank, "condition", "level above"), -EINVAL);
+	CHECK_EQ(mmio_host_store(&bank, "condition", "level above x"), -EINVAL);
+	CHECK_EQ(mmio_host_store(&bank, "condition", "level above -1"), -EINVAL);
+	CHECK_EQ(mmio_host_store(&bank, "condition", "level rate 5"), -EINVAL);
+	CHECK_EQ(mmio_host_store(&bank, "condition", "level rate 5 2000"), -EINVAL);
+	CHECK_EQ(mmio_host_store(&bank, "condition", "level mask 0x3 0x4"), -EINVAL);
+	CHECK_EQ(mmio_host_store(&bank, "condition", "level none 1"), -EINVAL);
+	CHECK_EQ(mmio_host_store(&bank, "condition", "level bogus 1"), -EINVAL);
+	CHECK_EQ(mmio_host_store(&bank, "condition", "nosuch above 1"), -ENOENT);
+
+	CHECK_EQ(mmio_host_store(&bank, "condition", "level none"), 10);
+	CHECK(mmio_host_show(&bank, "condition", buf) > 0);
+	CHECK(!strcmp(buf, "status mask 0xf0 0x10\n"));
+
+	// Unregistering drops the remaining condition's hold on the key
+	mmio_classdev_unregister(&bank);
+	CHECK_EQ(static_key_enabled(&mmio_notify_key), notifying);
+}
+
+struct decoded {
+	u64  expect[2][1000];     // Per entry, by seq
+	u64  start, period;
+	u32  ticks;
+	bool exact_times;
+};
+
+static void check_decoded(const struct mmio_sample *rec, void *arg)
+{
+	struct decoded *dec = arg;
+	unsigned int pos = rec->index - 1;
+
+	if (rec->seq >= 1000 || pos > 1)
+	{
+		failures++;
+		return;
+	}
+	CHECK_EQ(rec->value, dec->expect[pos][rec->seq]);
+	if (dec->exact_times)
+		CHECK_EQ(rec->time_ns, dec->start + rec->seq * dec->period);
+	if (pos == 0)
+		dec->ticks++;
+}
+
+// Decode the ring's bytes [tail, head), the way a reader would see them
+static void decode_ring(struct mmio_encoder *enc, struct mmio_decoder *d, u64 tail,
+						struct decoded *dec)
+{
+	static u8 buf[1 << 14];
+	u64 i, n = enc->head - tail;
+
+	for (i = 0; i < n; i++)
+		buf[i] = enc->data[(tail + i) & enc->mask];
+	CHECK_EQ(mmio_decode(d, buf, n, check_decoded, dec), n);
+}
+
+static void test_compressed(void)
+{
+	static const u32 indices[] = { 1, 2 };
+	static u8 ring[1 << 14];
+	static struct mmio_encoder enc;
+	static struct decoded dec;
+	struct mmio_decoder d;
+	u64 values[2], tail, dropped = 0;
+	u32 i;
+
+	// A slowly changing field next to a constant one compresses to runs
+	memset(&enc, 0, sizeof(enc));
+	memset(&dec, 0, sizeof(dec));
+	enc.data = ring;
+	enc.mask = sizeof(ring) - 1;
+	enc.count = 2;
+	dec.start = 5000;
+	dec.period = 1000;
+	dec.exact_times = true;
+	mmio_decoder_init(&d, indices, 2);
+
+	for (i = 0; i < 1000; i++)
+	{
+		values[0] = dec.expect[0][i] = i / 100;
+		values[1] = dec.expect[1][i] = 0xdeadbeef;
+		CHECK(mmio_encode_tick(&enc, 0, dec.start + i * dec.period, values));
+	}
+	mmio_encode_flush(&enc, 0);
+	CHECK(enc.head < 1000 * 2 * sizeof(struct mmio_sample) / 50);
+	decode_ring(&enc, &d, 0, &dec);
+	CHECK_EQ(dec.ticks, 1000);
+
+	// A full ring drops ticks without corrupting the ones after them
+	memset(&enc, 0, sizeof(enc));
+	memset(&dec, 0, sizeof(dec));
+	enc.data = ring;
+	enc.mask = 127;
+	enc.count = 2;
+	mmio_decoder_init(&d, indices, 2);
+
+	tail = 0;
+	for (i = 0; i < 1000; i++)
+	{
+		values[0] = dec.expect[0][i] = i * 0x12345ULL;
+		values[1] = dec.expect[1][i] = i & 0x40;
+		if (!mmio_encode_tick(&enc, tail, 1000 + i * 7, values))
+			dropped++;
+		// Drain only now and then
+		if (i % 50 == 49)
+		{
+			decode_ring(&enc, &d, tail, &dec);
+			tail = enc.head;
+		}
+	}
+	mmio_encode_flush(&enc, tail);
+	decode_ring(&enc, &d, tail, &dec);
+	CHECK(dropped > 0);
+	CHECK_EQ(dec.ticks + dropped, 1000);
+	CHECK_EQ(d.seq, 1000);
+}
+
+static int run_tests(void)
+{
+	test_register_validation();
+	test_get_set();
+	test_block_and_64bit();
+	test_store_parsing();
+	test_staged();
+	test_cached();
+	test_dump();
+	test_conditions();
+	test_stats();
+	test_compressed();
+
+	if (failures)
+		fprintf(stderr, "%d check(s) failed\n", failures);
+	else
+		printf("all tests passed\n");
+	return failures ? 1 : 0;
+}
+
+/*
+ * Benchmarks
+ */
+
+struct bench_width {
+	u8          size;
+	const char  *name;
+	u64         mask;
+};
+
+// Same banks as mmio_bench.c so host and kernel numbers line up
+static const struct bench_width bench_widths[] = {
+	{ 1, "mmio_bench8",  0xf0 },
+	{ 2, "mmio_bench16", 0x0ff0 },
+	{ 4, "mmio_bench32", 0x00fff000 },
+	{ 8, "mmio_bench64", 0x0000fffffff00000ULL },
+};
+
+struct bench_reader {
+	pthread_t             thread;
+	struct mmio_classdev  *bank;
+	struct mmio_entry     *entry;
+	volatile bool         *stop;
+	u64                   ops;
+};
+
+static u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void bench_report(const char *op, u8 size, unsigned int threads, u64 ops, u64 total_ns)
+{
+	printf("mmio_bench: op=%s size=%u threads=%u ops=%llu total_ns=%llu ns_per_op=%llu\n",
+		   op, size, threads, ops, total_ns, ops ? total_ns / ops : 0);
+}
+
+static void *bench_reader_fn(void *data)
+{
+	struct bench_reader *reader = data;
+
+	while (!*reader->stop)
+	{
+		mmio_get_value(reader->bank, reader->entry);
+		__atomic_store_n(&reader->ops, reader->ops + 1, __ATOMIC_RELAXED);
+	}
+	return NULL;
+}
+
+static u64 bench_reader_ops(struct bench_reader *rd, unsigned int n)
+{
+	u64 ops = 0;
+	unsigned int i;
+
+	for (i = 0; i < n; i++)
+		ops += __atomic_load_n(&rd[i].ops, __ATOMIC_RELAXED);
+	return ops;
+}
+
+static void bench_width(const struct bench_width *width, unsigned int iterations,
+						unsigned int readers)
+{
+	struct mmio_entry entry = { .name = "field", .mask = width->mask, .flags = MMIO_ENTRY_RW };
+	u64 start, elapsed, ops, sum = 0, max = width->mask >> __ffs64(width->mask);
+	struct bench_reader *rd;
+	volatile bool stop = false;
+	struct mmio_classdev bank;
+	unsigned int i, n = 0;
+	char buf[64];
+
+	mmio_host_bank(&bank, width->name, width->size, &entry, 1);
+	if (mmio_classdev_register(NULL, &bank))
+	{
+		fprintf(stderr, "failed to register %s\n", width->name);
+		failures++;
+		return;
+	}
+
+	start = now_ns();
+	for (i = 0; i < iterations; i++)
+		sum += mmio_get_value(&bank, &entry);
+	bench_report("get", width->size, 1, iterations, now_ns() - start);
+
+	start = now_ns();
+	for (i = 0; i < iterations; i++)
+		mmio_set_value(&bank, &entry, i & max);
+	bench_report("set", width->size, 1, iterations, now_ns() - start);
+
+	start = now_ns();
+	for (i = 0; i < iterations; i++)
+		entry.attr.store(bank.dev, &entry.attr, "5\n", 2);
+	bench_report("store", width->size, 1, iterations, now_ns() - start);
+
+	start = now_ns();
+	for (i = 0; i < iterations; i++)
+		entry.attr.show(bank.dev, &entry.attr, buf);
+	bench_report("show", width->size, 1, iterations, now_ns() - start);
+
+	rd = calloc(readers ? readers : 1, sizeof(*rd));
+	for (i = 0; rd && i < readers; i++)
+	{
+		rd[i].bank = &bank;
+		rd[i].entry = &entry;
+		rd[i].stop = &stop;
+		if (pthread_create(&rd[i].thread, NULL, bench_reader_fn, &rd[i]))
+			break;
+		n++;
+	}
+
+	// Let every reader get going before the clock starts
+	for (i = 0; i < n; i++)
+	{
+		while (!__atomic_load_n(&rd[i].ops, __ATOMIC_RELAXED))
+			sched_yield();
+	}
+
+	ops = bench_reader_ops(rd, n);
+	start = now_ns();
+	for (i = 0; i < iterations; i++)
+		mmio_set_value(&bank, &entry, i & max);
+	elapsed = now_ns() - start;
+	ops = bench_reader_ops(rd, n) - ops;
+
+	stop = true;
+	for (i = 0; i < n; i++)
+		pthread_join(rd[i].thread, NULL);
+	free(rd);
+
+	bench_report("set_contended", width->size, n + 1, iterations, elapsed);
+	bench_report("get_contended", width->size, n + 1, ops, elapsed * n);
+
+	if (sum)
+		failures++;
+	mmio_classdev_unregister(&bank);
+}
+
+static int run_bench(unsigned int iterations, unsigned int readers)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(bench_widths); i++)
+		bench_width(&bench_widths[i], iterations, readers);
+	return failures ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int iterations = 1000000, readers = 2;
+	int ret;
+
+	ret = mmio_host_init();
+	if (ret)
+	{
+		fprintf(stderr, "mmio_host_init: %s\n", strerror(-ret));
+		return 1;
+	}
+
+	if (argc > 1 && !strcmp(argv[1], "bench"))
+	{
+		if (argc > 2)
+			iterations = strtoul(argv[2], NULL, 0);
+		if (argc > 3)
+			readers = strtoul(argv[3], NULL, 0);
+		ret = run_bench(iterations, readers);
+	}
+	else if (argc == 1 || !strcmp(argv[1], "test"))
+	{
+		ret = run_tests();
+	}
+	else
+	{
+		fprintf(stderr, "usage: %s [test | bench [iterations] [readers]]\n", argv[0]);
+		ret = 2;
+	}
+
+	mmio_host_exit();
+	return ret;
+}
@@ -2,39 +2,162 @@
 #define __LINUX_MMIO_H_INCLUDED
 
 #include <linux/rwsem.h>
+#include <linux/spinlock.h>
 #include <linux/device.h>
 
 #define MMIO_ENTRY_RW        (MMIO_ENTRY_READ | MMIO_ENTRY_WRITE)
 #define MMIO_ENTRY_READ      (1 << 0)
 #define MMIO_ENTRY_WRITE     (1 << 1)
+#define MMIO_ENTRY_VOLATILE  (1 << 2)   // Always read from the bus, even on cached banks
+#define MMIO_ENTRY_WATCH     (1 << 3)   // Watch for changes from registration on, see mmio_watch
+
+#define MMIO_BANK_STAGED     (1 << 0)   // Sysfs writes are buffered until "commit"
+#define MMIO_BANK_CACHED     (1 << 1)   // Keep a shadow of the registers in memory
+#define MMIO_BANK_WRITE_ONLY (1 << 2)   // Registers can't be read back, implies MMIO_BANK_CACHED
+#define MMIO_BANK_READ_SIDE_EFFECTS (1 << 3)   // Reads change the hardware, always lock them
+#define MMIO_BANK_ATOMIC     (1 << 4)   // Lock with a raw spinlock, usable from IRQ context
 
 struct device;
+struct dentry;
+struct mmio_classdev;
+struct mmio_handle;
+struct mmio_reg;
+struct mmio_stats;
+struct mmio_watcher;
+struct notifier_block;
+
+// How a change was seen, the action passed to entry notifiers
+#define MMIO_CHANGE_WRITE    0          // A write through mmio_set_value
+#define MMIO_CHANGE_POLL     1          // The watcher's polling
+#define MMIO_CHANGE_IRQ      2          // The bank's interrupt
+
+// Conditions that must be met to notify a watched entry, see mmio_cond.c
+#define MMIO_COND_NONE       0          // Any change
+#define MMIO_COND_ABOVE      1          // Rises above threshold
+#define MMIO_COND_BELOW      2          // Falls below threshold
+#define MMIO_COND_RATE       3          // Moves by delta over samples observations
+#define MMIO_COND_MASK       4          // Bits in mask come to equal match
+
+#define MMIO_COND_MAX_SAMPLES  1024
+
+struct mmio_condition {
+	unsigned int  type;         // MMIO_COND_*
+	u64           threshold;    // above, below
+	u64           hysteresis;   // above, below: how far back to re-arm
+	u64           delta;        // rate
+	unsigned int  samples;      // rate
+	u64           mask;         // mask
+	u64           match;        // mask
+};
+
+// The data passed to entry notifiers
+struct mmio_change {
+	struct mmio_classdev  *mmio_cdev;
+	struct mmio_entry     *entry;
+	u64                   old;
+	u64                   value;
+};
+
+/*
+ * Optional replacement for the __raw_read/__raw_write bus accesses of a bank,
+ * e.g. for simulated banks. The register's addr and size say what to access.
+ */
+struct mmio_bus_ops {
+	u64  (*read)(struct mmio_classdev *mmio_cdev, struct mmio_reg *reg);
+	void (*write)(struct mmio_classdev *mmio_cdev, struct mmio_reg *reg, u64 val);
+};
+
+/*
+ * One register of a bank, shared by all entries at the same offset.
+ * Populated automatically.
+ */
+struct mmio_reg {
+	struct mmio_classdev     *parent;
+	void __iomem             *addr;
+	u64                      (*read)(struct mmio_reg *reg);
+	void                     (*write)(struct mmio_reg *reg, u64 val);
+	unsigned int             offset;     // Offset from the bank's offset
+	u8                       size;
+	
+	struct rw_semaphore      rwsem;
+	raw_spinlock_t           lock;       // Used instead of rwsem by MMIO_BANK_ATOMIC banks
+	u64                      staged_mask;  // Bits with a value waiting for commit
+	u64                      staged_value;
+	u64                      shadow;       // Last known value on cached banks
+	bool                     shadow_valid;
+};
 
 struct mmio_classdev {
 	 const char           *name;    // Name of folder to put in /sys/class/mmio
-	 u8                   size;     // Size in bytes of this bank (1, 2 or 4)
+	 u8                   size;     // Default register size in bytes of this bank (1, 2, 4 or 8)
 	 struct mmio_entry    *entries; // Array of mmio entries
 	 unsigned int         num_entries;
 	 unsigned int         offset;   // Offset from base for this bank
 	 void                 *base;    // io_remap'd base of mmio memory
+	 phys_addr_t          phys;     // Physical address of base, needed for mmap
+	 const struct mmio_bus_ops *ops;  // Optional, replaces __raw_read/__raw_write
+	 unsigned long        flags;    // MMIO_BANK_* flags
+	 u64                  reset_value;  // Initial shadow of MMIO_BANK_WRITE_ONLY registers
+	 int                  irq;      // Optional interrupt raised on changes, see mmio_watch.c
+	 unsigned long        irq_flags;    // Extra request_threaded_irq flags, e.g. IRQF_SHARED
+	 struct mmio_entry    *irq_status;  // Optional entry read once per interrupt
+	 struct mmio_entry    *irq_ack;     // Optional entry the status value is written to
+	 
+	 struct mmio_reg      *regs;    // One per register offset, populated automatically
+	 unsigned int         num_regs;
+	 unsigned int         span;     // Bytes from offset to the end of the last register
 	 
 	 struct device        *dev;
 	 struct list_head     node;     // MMIO Device list
-	 struct rw_semaphore  rwsem;
+	 struct mmio_handle   *handle;  // /dev/mmio/<name>, see mmio_cdev.c
+	 struct mmio_stats __percpu *stats;  // Access counters, see mmio_debugfs.c
+	 struct dentry        *debugfs; // debugfs/mmio/<name>
+	 unsigned int         slow_threshold_us;  // Trace bus accesses slower than this, 0 for none
+	 struct mmio_watcher  *watcher; // Change watcher, see mmio_watch.c
 };
  
 struct mmio_entry {
 	const char               *name;
-	u32                      mask;       // Mask to apply and shift to get mmio value
+	u64                      mask;       // Mask to apply and shift to get mmio value
 	unsigned long            flags;      // Directionality and such. Defaults to just MMIO_ENTRY_RW
+	unsigned int             offset;     // Offset of the entry's register from the bank's offset
+	u8                       size;       // Register size in bytes, 0 for the bank's size
+	unsigned int             watch_ms;   // Poll interval of MMIO_ENTRY_WATCH entries, 0 for adaptive
 	
 	struct device_attribute  attr;       // Populated automatically
+	struct mmio_reg          *reg;       // Populated automatically
+	u64                      max;        // Largest field value, populated automatically
+	u8                       shift;      // Position of the mask, populated automatically
 };
 
 extern int  mmio_classdev_register(struct device *parent, struct mmio_classdev *mmio_cdev);
 extern void mmio_classdev_unregister(struct mmio_classdev *mmio_cdev);
 
-extern int mmio_set_value(struct mmio_classdev *parent, struct mmio_entry *entry, unsigned long value);
-extern u32 mmio_get_value(struct mmio_classdev *parent, struct mmio_entry *entry);
+extern int mmio_set_value(struct mmio_classdev *parent, struct mmio_entry *entry, u64 value);
+extern u64 mmio_get_value(struct mmio_classdev *parent, struct mmio_entry *entry);
+extern int mmio_get_values(struct mmio_classdev *parent, unsigned int first, unsigned int count,
+						   u64 *values);
+
+extern int mmio_set_value_atomic(struct mmio_classdev *parent, struct mmio_entry *entry, u64 value);
+extern u64 mmio_get_value_atomic(struct mmio_classdev *parent, struct mmio_entry *entry);
+extern int mmio_wait_value(struct mmio_classdev *parent, struct mmio_entry *entry,
+						   u64 value, u64 mask, u64 timeout_us);
+
+extern int  mmio_stage_value(struct mmio_classdev *parent, struct mmio_entry *entry, u64 value);
+extern int  mmio_commit(struct mmio_classdev *parent);
+extern void mmio_abort(struct mmio_classdev *parent);
+
+extern int  mmio_sync(struct mmio_classdev *parent);
+extern void mmio_invalidate(struct mmio_classdev *parent);
+
+extern int  mmio_watch(struct mmio_classdev *parent, struct mmio_entry *entry, unsigned int interval_ms);
+extern void mmio_unwatch(struct mmio_classdev *parent, struct mmio_entry *entry);
+extern int  mmio_watch_condition(struct mmio_classdev *parent, struct mmio_entry *entry,
+								 const struct mmio_condition *cond);
+
+extern int mmio_entry_register_notifier(struct mmio_classdev *parent, struct mmio_entry *entry,
+										struct notifier_block *nb);
+extern int mmio_entry_unregister_notifier(struct mmio_classdev *parent, struct mmio_entry *entry,
+										  struct notifier_block *nb);
 
 #endif
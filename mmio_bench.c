@@ -0,0 +1,264 @@
+/*
+ * MMIO KUnit micro-benchmarks
+ *
+ * Copyright (C) 2014 Joe Balough <jbb5044@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Registers a memory-backed bank of each register size and times the get,
+ * set and sysfs show/store paths, alone and with concurrent readers. Every
+ * measurement is reported as one line of the form
+ *
+ *   mmio_bench: op=<op> size=<bytes> threads=<n> ops=<n> total_ns=<ns> ns_per_op=<ns>
+ *
+ * Run it with: ./tools/testing/kunit/kunit.py run --kunitconfig=<this dir>
+ */
+
+#include <kunit/test.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/device.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/slab.h>
+#include "mmio.h"
+
+static unsigned int iterations = 100000;
+module_param(iterations, uint, 0444);
+MODULE_PARM_DESC(iterations, "Operations timed per measurement");
+
+static unsigned int readers = 2;
+module_param(readers, uint, 0444);
+MODULE_PARM_DESC(readers, "Concurrent reader threads in the contended benchmarks");
+
+struct mmio_bench_width {
+	u8          size;
+	const char  *name;
+	u64         mask;
+};
+
+// Masks are away from bit 0 so the field shift is part of what is timed
+static const struct mmio_bench_width mmio_bench_widths[] = {
+	{ 1, "mmio_bench8",  0xf0 },
+	{ 2, "mmio_bench16", 0x0ff0 },
+	{ 4, "mmio_bench32", 0x00fff000 },
+	{ 8, "mmio_bench64", 0x0000fffffff00000ULL },
+};
+
+static void mmio_bench_width_desc(const struct mmio_bench_width *width, char *desc)
+{
+	snprintf(desc, KUNIT_PARAM_DESC_SIZE, "%u bytes", width->size);
+}
+
+KUNIT_ARRAY_PARAM(mmio_bench_width, mmio_bench_widths, mmio_bench_width_desc);
+
+struct mmio_bench {
+	struct mmio_classdev           mmio_cdev;
+	struct mmio_entry              entry;
+	const struct mmio_bench_width  *width;
+	bool                           registered;
+};
+
+struct mmio_bench_reader {
+	struct task_struct  *task;
+	struct mmio_bench   *bench;
+	u64                 ops;
+};
+
+static struct mmio_bench *mmio_bench_setup(struct kunit *test)
+{
+	const struct mmio_bench_width *width = test->param_value;
+	struct mmio_bench *bench;
+
+	bench = kunit_kzalloc(test, sizeof(*bench), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, bench);
+
+	bench->width = width;
+	bench->entry.name = "field";
+	bench->entry.mask = width->mask;
+	bench->entry.flags = MMIO_ENTRY_RW;
+
+	bench->mmio_cdev.name = width->name;
+	bench->mmio_cdev.size = width->size;
+	bench->mmio_cdev.entries = &bench->entry;
+	bench->mmio_cdev.num_entries = 1;
+	bench->mmio_cdev.base = kunit_kzalloc(test, sizeof(u64), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, bench->mmio_cdev.base);
+
+	KUNIT_ASSERT_EQ(test, mmio_classdev_register(NULL, &bench->mmio_cdev), 0);
+	bench->registered = true;
+	test->priv = bench;
+
+	return bench;
+}
+
+static void mmio_bench_report(struct kunit *test, const char *op,
+							  unsigned int threads, u64 ops, u64 total_ns)
+{
+	struct mmio_bench *bench = test->priv;
+
+	kunit_info(test, "mmio_bench: op=%s size=%u threads=%u ops=%llu total_ns=%llu ns_per_op=%llu\n",
+			   op, bench->width->size, threads, ops, total_ns,
+			   ops ? div64_u64(total_ns, ops) : 0);
+}
+
+static void mmio_bench_get(struct kunit *test)
+{
+	struct mmio_bench *bench = mmio_bench_setup(test);
+	u64 start, sum = 0;
+	unsigned int i;
+
+	start = ktime_get_ns();
+	for (i = 0; i < iterations; i++)
+		sum += mmio_get_value(&bench->mmio_cdev, &bench->entry);
+	mmio_bench_report(test, "get", 1, iterations, ktime_get_ns() - start);
+
+	KUNIT_EXPECT_EQ(test, sum, 0);
+}
+
+static void mmio_bench_set(struct kunit *test)
+{
+	struct mmio_bench *bench = mmio_bench_setup(test);
+	u64 start, max = bench->width->mask >> __ffs64(bench->width->mask);
+	unsigned int i;
+	int ret = 0;
+
+	start = ktime_get_ns();
+	for (i = 0; i < iterations; i++)
+		ret |= mmio_set_value(&bench->mmio_cdev, &bench->entry, i & max);
+	mmio_bench_report(test, "set", 1, iterations, ktime_get_ns() - start);
+
+	KUNIT_EXPECT_EQ(test, ret, 0);
+}
+
+static void mmio_bench_show_store(struct kunit *test)
+{
+	struct mmio_bench *bench = mmio_bench_setup(test);
+	struct device_attribute *attr = &bench->entry.attr;
+	struct device *dev = bench->mmio_cdev.dev;
+	ssize_t ret = 0;
+	unsigned int i;
+	char *buf;
+	u64 start;
+
+	buf = kunit_kzalloc(test, PAGE_SIZE, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, buf);
+
+	start = ktime_get_ns();
+	for (i = 0; i < iterations; i++)
+		ret = min(ret, attr->store(dev, attr, "5\n", 2));
+	mmio_bench_report(test, "store", 1, iterations, ktime_get_ns() - start);
+	KUNIT_EXPECT_GE(test, ret, 0);
+
+	start = ktime_get_ns();
+	for (i = 0; i < iterations; i++)
+		ret = min(ret, attr->show(dev, attr, buf));
+	mmio_bench_report(test, "show", 1, iterations, ktime_get_ns() - start);
+	KUNIT_EXPECT_GE(test, ret, 0);
+	KUNIT_EXPECT_STREQ(test, buf, "5\n");
+}
+
+static int mmio_bench_reader_fn(void *data)
+{
+	struct mmio_bench_reader *reader = data;
+	struct mmio_bench *bench = reader->bench;
+
+	while (!kthread_should_stop())
+	{
+		mmio_get_value(&bench->mmio_cdev, &bench->entry);
+		WRITE_ONCE(reader->ops, reader->ops + 1);
+		if (!(reader->ops & 1023))
+			cond_resched();
+	}
+
+	return 0;
+}
+
+static u64 mmio_bench_reader_ops(struct mmio_bench_reader *rd, unsigned int n)
+{
+	u64 ops = 0;
+	unsigned int i;
+
+	for (i = 0; i < n; i++)
+		ops += READ_ONCE(rd[i].ops);
+	return ops;
+}
+
+/*
+ * One writer setting the field while the reader threads read it. The writer
+ * is timed per set, the readers by how many gets they finish meanwhile.
+ */
+static void mmio_bench_contended(struct kunit *test)
+{
+	struct mmio_bench *bench = mmio_bench_setup(test);
+	u64 start, elapsed, ops, max = bench->width->mask >> __ffs64(bench->width->mask);
+	struct mmio_bench_reader *rd;
+	unsigned int i, n = 0;
+	int ret = 0;
+
+	rd = kunit_kcalloc(test, readers, sizeof(*rd), GFP_KERNEL);
+	KUNIT_ASSERT_TRUE(test, rd || !readers);
+
+	for (i = 0; i < readers; i++)
+	{
+		rd[i].bench = bench;
+		rd[i].task = kthread_run(mmio_bench_reader_fn, &rd[i], "mmio_bench/%u", i);
+		if (IS_ERR(rd[i].task))
+			break;
+		n++;
+	}
+
+	// Let every reader get going before the clock starts
+	for (i = 0; i < n; i++)
+	{
+		while (!READ_ONCE(rd[i].ops))
+			cond_resched();
+	}
+
+	ops = mmio_bench_reader_ops(rd, n);
+	start = ktime_get_ns();
+	for (i = 0; i < iterations; i++)
+		ret |= mmio_set_value(&bench->mmio_cdev, &bench->entry, i & max);
+	elapsed = ktime_get_ns() - start;
+	ops = mmio_bench_reader_ops(rd, n) - ops;
+
+	for (i = 0; i < n; i++)
+		kthread_stop(rd[i].task);
+
+	mmio_bench_report(test, "set_contended", n + 1, iterations, elapsed);
+	mmio_bench_report(test, "get_contended", n + 1, ops, elapsed * n);
+
+	KUNIT_EXPECT_EQ(test, n, readers);
+	KUNIT_EXPECT_EQ(test, ret, 0);
+}
+
+static void mmio_bench_exit(struct kunit *test)
+{
+	struct mmio_bench *bench = test->priv;
+
+	if (bench && bench->registered)
+		mmio_classdev_unregister(&bench->mmio_cdev);
+}
+
+static struct kunit_case mmio_bench_cases[] = {
+	KUNIT_CASE_PARAM(mmio_bench_get, mmio_bench_width_gen_params),
+	KUNIT_CASE_PARAM(mmio_bench_set, mmio_bench_width_gen_params),
+	KUNIT_CASE_PARAM(mmio_bench_show_store, mmio_bench_width_gen_params),
+	KUNIT_CASE_PARAM(mmio_bench_contended, mmio_bench_width_gen_params),
+	{}
+};
+
+static struct kunit_suite mmio_bench_suite = {
+	.name = "mmio_bench",
+	.exit = mmio_bench_exit,
+	.test_cases = mmio_bench_cases,
+};
+
+kunit_test_suite(mmio_bench_suite);
+
+MODULE_AUTHOR("Joe Balough <jbb5044@gmail.com>");
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("MMIO Class KUnit Benchmarks");
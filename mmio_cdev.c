@@ -0,0 +1,541 @@
+/*
+ * MMIO character device interface
+ *
+ * Copyright (C) 2014 Joe Balough <jbb5044@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/device.h>
+#include <linux/cdev.h>
+#include <linux/fs.h>
+#include <linux/idr.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/uaccess.h>
+#include "mmio_cdev.h"
+#include "mmio_ioctl.h"
+
+#define MMIO_DEV_MAX 1024
+
+static dev_t mmio_devt;
+static DEFINE_IDR(mmio_minor_idr);    // Minor to struct mmio_handle
+static DEFINE_MUTEX(mmio_minor_lock);
+
+
+/**
+ * mmio_cdev_op - Run a single read or write on an entry of a bank
+ * @mmio_cdev The mmio_classdev bank containing the entry
+ * @index     Index of the entry in mmio_cdev->entries
+ * @op        MMIO_OP_READ or MMIO_OP_WRITE
+ * @value     Value to write, or where to put the value read
+ */
+static int mmio_cdev_op(struct mmio_classdev *mmio_cdev, u32 index, u32 op, u64 *value)
+{
+	struct mmio_entry *entry;
+
+	if (index >= mmio_cdev->num_entries)
+		return -EINVAL;
+
+	entry = &(mmio_cdev->entries[index]);
+	if (!entry->mask)
+		return -ENOENT;
+
+	switch (op)
+	{
+		case MMIO_OP_READ:
+			if (! (entry->flags & MMIO_ENTRY_READ) )
+				return -EPERM;
+			*value = mmio_get_value(mmio_cdev, entry);
+			return 0;
+		case MMIO_OP_WRITE:
+			if (! (entry->flags & MMIO_ENTRY_WRITE) )
+				return -EPERM;
+			return mmio_set_value(mmio_cdev, entry, *value);
+	}
+
+	return -EINVAL;
+}
+
+struct mmio_handle *mmio_handle_get(struct mmio_handle *h)
+{
+	kref_get(&h->ref);
+	return h;
+}
+
+static void mmio_handle_free(struct kref *ref)
+{
+	kfree(container_of(ref, struct mmio_handle, ref));
+}
+
+void mmio_handle_put(struct mmio_handle *h)
+{
+	kref_put(&h->ref, mmio_handle_free);
+}
+
+// The file's bank with its handle's lock held for read, NULL once unregistered
+static struct mmio_classdev *mmio_cdev_lock(struct file *filp)
+{
+	struct mmio_handle *h = filp->private_data;
+	struct mmio_classdev *mmio_cdev;
+
+	down_read(&h->lock);
+	mmio_cdev = h->mmio_cdev;
+	if (!mmio_cdev)
+		up_read(&h->lock);
+	return mmio_cdev;
+}
+
+static void mmio_cdev_unlock(struct file *filp)
+{
+	struct mmio_handle *h = filp->private_data;
+
+	up_read(&h->lock);
+}
+
+static int mmio_cdev_open(struct inode *inode, struct file *filp)
+{
+	struct mmio_handle *h;
+
+	mutex_lock(&mmio_minor_lock);
+	h = idr_find(&mmio_minor_idr, iminor(inode));
+	if (h)
+		mmio_handle_get(h);
+	mutex_unlock(&mmio_minor_lock);
+
+	if (!h)
+		return -ENODEV;
+	filp->private_data = h;
+	return 0;
+}
+
+static int mmio_cdev_release(struct inode *inode, struct file *filp)
+{
+	mmio_handle_put(filp->private_data);
+	return 0;
+}
+
+/**
+ * mmio_cdev_read - Read one struct mmio_record per entry, starting at the
+ * entry selected by the file position.
+ *
+ * All the entries returned come from one mmio_get_values, so a read of the
+ * whole bank is a consistent dump that reads each register once.
+ */
+static ssize_t mmio_cdev_read(struct file *filp, char __user *buf,
+							  size_t count, loff_t *ppos)
+{
+	struct mmio_classdev *mmio_cdev;
+	struct mmio_record *recs = NULL;
+	struct mmio_entry *entry;
+	unsigned int first, n, i;
+	u64 *values = NULL;
+	ssize_t ret;
+
+	if (*ppos % sizeof(*recs) || count % sizeof(*recs))
+		return -EINVAL;
+
+	mmio_cdev = mmio_cdev_lock(filp);
+	if (!mmio_cdev)
+		return -ENODEV;
+
+	ret = 0;
+	if (*ppos / sizeof(*recs) >= mmio_cdev->num_entries)
+		goto out;
+
+	first = *ppos / sizeof(*recs);
+	n = min_t(size_t, count / sizeof(*recs), mmio_cdev->num_entries - first);
+	if (n == 0)
+		goto out;
+
+	values = kmalloc_array(n, sizeof(*values), GFP_KERNEL);
+	recs = kmalloc_array(n, sizeof(*recs), GFP_KERNEL);
+	if (!values || !recs)
+	{
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	ret = mmio_get_values(mmio_cdev, first, n, values);
+	if (ret)
+		goto out;
+
+	for (i = 0; i < n; i++)
+	{
+		entry = &(mmio_cdev->entries[first + i]);
+		recs[i].index = first + i;
+		recs[i].value = values[i];
+		if (!entry->mask)
+			recs[i].result = -ENOENT;
+		else if (! (entry->flags & MMIO_ENTRY_READ) )
+			recs[i].result = -EPERM;
+		else
+			recs[i].result = 0;
+	}
+
+	ret = n * sizeof(*recs);
+	if (copy_to_user(buf, recs, ret))
+	{
+		ret = -EFAULT;
+		goto out;
+	}
+	*ppos += ret;
+
+	out:
+	mmio_cdev_unlock(filp);
+	kfree(recs);
+	kfree(values);
+	return ret;
+}
+
+/**
+ * mmio_cdev_write - Set each entry named in an array of struct mmio_record.
+ */
+static ssize_t mmio_cdev_write(struct file *filp, const char __user *buf,
+							   size_t count, loff_t *ppos)
+{
+	struct mmio_classdev *mmio_cdev;
+	struct mmio_record rec;
+	size_t done = 0;
+	int ret = 0;
+
+	if (count % sizeof(rec))
+		return -EINVAL;
+
+	mmio_cdev = mmio_cdev_lock(filp);
+	if (!mmio_cdev)
+		return -ENODEV;
+
+	while (done < count)
+	{
+		ret = -EFAULT;
+		if (copy_from_user(&rec, buf + done, sizeof(rec)))
+			break;
+
+		ret = mmio_cdev_op(mmio_cdev, rec.index, MMIO_OP_WRITE, &rec.value);
+		if (ret < 0)
+			break;
+		done += sizeof(rec);
+	}
+
+	mmio_cdev_unlock(filp);
+	return done ? done : ret;
+}
+
+/**
+ * mmio_cdev_batch - Run a vector of struct mmio_op. Every op is attempted;
+ * failures are reported in the op's result field.
+ *
+ * Like write(), writes need the file to be open for writing, and fail with
+ * -EBADF otherwise.
+ */
+static long mmio_cdev_batch(struct mmio_classdev *mmio_cdev, struct file *filp,
+							void __user *argp)
+{
+	struct mmio_batch batch;
+	struct mmio_op *ops;
+	void __user *uops;
+	unsigned int i;
+	long ret = 0;
+
+	if (copy_from_user(&batch, argp, sizeof(batch)))
+		return -EFAULT;
+	if (batch.count == 0)
+		return 0;
+	if (batch.count > MMIO_BATCH_MAX)
+		return -E2BIG;
+
+	uops = u64_to_user_ptr(batch.ops);
+	ops = memdup_user(uops, batch.count * sizeof(*ops));
+	if (IS_ERR(ops))
+		return PTR_ERR(ops);
+
+	for (i = 0; i < batch.count; i++)
+	{
+		if (ops[i].op == MMIO_OP_WRITE && !(filp->f_mode & FMODE_WRITE))
+			ops[i].result = -EBADF;
+		else
+			ops[i].result = mmio_cdev_op(mmio_cdev, ops[i].index, ops[i].op, &ops[i].value);
+	}
+
+	if (copy_to_user(uops, ops, batch.count * sizeof(*ops)))
+		ret = -EFAULT;
+
+	kfree(ops);
+	return ret;
+}
+
+static long __mmio_cdev_ioctl(struct mmio_classdev *mmio_cdev, struct file *filp,
+							  unsigned int cmd, void __user *argp)
+{
+	struct mmio_bank_info bank;
+	struct mmio_entry_info info;
+	struct mmio_wait wait;
+	struct mmio_entry *entry;
+
+	switch (cmd)
+	{
+		case MMIO_IOC_BANK_INFO:
+			memset(&bank, 0, sizeof(bank));
+			strscpy(bank.name, mmio_cdev->name, sizeof(bank.name));
+			bank.size = mmio_cdev->size;
+			bank.offset = mmio_cdev->offset;
+			bank.num_entries = mmio_cdev->num_entries;
+			bank.map_offset = (mmio_cdev->phys + mmio_cdev->offset) & ~PAGE_MASK;
+			bank.span = mmio_cdev->span;
+			bank.num_regs = mmio_cdev->num_regs;
+			if (copy_to_user(argp, &bank, sizeof(bank)))
+				return -EFAULT;
+			return 0;
+
+		case MMIO_IOC_ENTRY_INFO:
+			if (copy_from_user(&info, argp, sizeof(info)))
+				return -EFAULT;
+			if (info.index >= mmio_cdev->num_entries)
+				return -EINVAL;
+			entry = &(mmio_cdev->entries[info.index]);
+			info.flags = entry->flags;
+			info.mask = entry->mask;
+			info.offset = entry->offset;
+			info.size = entry->reg->size;
+			strscpy(info.name, entry->name, sizeof(info.name));
+			if (copy_to_user(argp, &info, sizeof(info)))
+				return -EFAULT;
+			return 0;
+
+		case MMIO_IOC_BATCH:
+			return mmio_cdev_batch(mmio_cdev, filp, argp);
+
+		case MMIO_IOC_SAMPLE:
+			return mmio_sampler_start(mmio_cdev, filp, argp);
+
+		case MMIO_IOC_CAPTURE:
+			return mmio_capture_start(mmio_cdev, filp, argp);
+
+		case MMIO_IOC_SUBSCRIBE:
+			return mmio_event_subscribe(mmio_cdev, filp, argp);
+
+		case MMIO_IOC_WAIT:
+			if (copy_from_user(&wait, argp, sizeof(wait)))
+				return -EFAULT;
+			if (wait.index >= mmio_cdev->num_entries || wait.reserved)
+				return -EINVAL;
+			return mmio_wait_value(mmio_cdev, &(mmio_cdev->entries[wait.index]),
+								   wait.value, wait.mask, wait.timeout_us);
+	}
+
+	return -ENOTTY;
+}
+
+static long mmio_cdev_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
+{
+	struct mmio_classdev *mmio_cdev;
+	long ret;
+
+	mmio_cdev = mmio_cdev_lock(filp);
+	if (!mmio_cdev)
+		return -ENODEV;
+
+	ret = __mmio_cdev_ioctl(mmio_cdev, filp, cmd, (void __user *) arg);
+	mmio_cdev_unlock(filp);
+	return ret;
+}
+
+/**
+ * __mmio_cdev_mmap - Map the pages covering the bank's registers, uncached.
+ *
+ * Only the bank's own registers are described by the entries, but whole
+ * pages are visible, so anything else sharing those pages is exposed as well.
+ * Accesses through the mapping bypass the registers' locks.
+ */
+static int __mmio_cdev_mmap(struct mmio_classdev *mmio_cdev, struct vm_area_struct *vma)
+{
+	unsigned long size = vma->vm_end - vma->vm_start;
+	phys_addr_t addr;
+	bool writable = false;
+	int i;
+
+	if (!mmio_cdev->phys)
+		return -ENODEV;
+
+	addr = mmio_cdev->phys + mmio_cdev->offset;
+	if (vma->vm_pgoff != 0 || size > PAGE_ALIGN((addr & ~PAGE_MASK) + mmio_cdev->span))
+		return -EINVAL;
+
+	for (i = 0; i < mmio_cdev->num_entries; i++)
+	{
+		if (mmio_cdev->entries[i].mask && (mmio_cdev->entries[i].flags & MMIO_ENTRY_WRITE))
+		{
+			writable = true;
+			break;
+		}
+	}
+	if (!writable)
+	{
+		if (vma->vm_flags & VM_WRITE)
+			return -EPERM;
+		vm_flags_clear(vma, VM_MAYWRITE);
+	}
+
+	vm_flags_set(vma, VM_IO | VM_DONTEXPAND | VM_DONTDUMP);
+	vma->vm_page_prot = pgprot_noncached(vma->vm_page_prot);
+
+	return io_remap_pfn_range(vma, vma->vm_start, addr >> PAGE_SHIFT,
+							  size, vma->vm_page_prot);
+}
+
+static int mmio_cdev_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	struct mmio_classdev *mmio_cdev;
+	int ret;
+
+	mmio_cdev = mmio_cdev_lock(filp);
+	if (!mmio_cdev)
+		return -ENODEV;
+
+	ret = __mmio_cdev_mmap(mmio_cdev, vma);
+	mmio_cdev_unlock(filp);
+	return ret;
+}
+
+static const struct file_operations mmio_fops = {
+	.owner          = THIS_MODULE,
+	.open           = mmio_cdev_open,
+	.release        = mmio_cdev_release,
+	.read           = mmio_cdev_read,
+	.write          = mmio_cdev_write,
+	.llseek         = default_llseek,
+	.unlocked_ioctl = mmio_cdev_ioctl,
+	.compat_ioctl   = compat_ptr_ioctl,
+	.mmap           = mmio_cdev_mmap,
+};
+
+/**
+ * mmio_cdev_add - Allocate a minor and add the character device for a bank.
+ * @mmio_cdev: The bank, not yet added to the class
+ * @devt:      Filled in with the device number to pass to device_create
+ */
+int mmio_cdev_add(struct mmio_classdev *mmio_cdev, dev_t *devt)
+{
+	struct mmio_handle *h;
+	int ret;
+
+	h = kzalloc(sizeof(*h), GFP_KERNEL);
+	if (!h)
+		return -ENOMEM;
+
+	kref_init(&h->ref);
+	init_rwsem(&h->lock);
+	mutex_init(&h->session_lock);
+	INIT_LIST_HEAD(&h->sessions);
+
+	// Allocated, the cdev lives on until the last file using it is gone
+	h->cdev = cdev_alloc();
+	if (!h->cdev)
+	{
+		ret = -ENOMEM;
+		goto failed_free;
+	}
+	h->cdev->ops = &mmio_fops;
+	h->cdev->owner = THIS_MODULE;
+
+	mutex_lock(&mmio_minor_lock);
+	h->minor = idr_alloc(&mmio_minor_idr, h, 0, MMIO_DEV_MAX, GFP_KERNEL);
+	mutex_unlock(&mmio_minor_lock);
+	if (h->minor < 0)
+	{
+		ret = h->minor;
+		goto failed_put_cdev;
+	}
+
+	*devt = MKDEV(MAJOR(mmio_devt), h->minor);
+	ret = cdev_add(h->cdev, *devt, 1);
+	if (ret)
+		goto failed_remove_minor;
+
+	mmio_cdev->handle = h;
+	return 0;
+
+	failed_remove_minor:
+	mutex_lock(&mmio_minor_lock);
+	idr_remove(&mmio_minor_idr, h->minor);
+	mutex_unlock(&mmio_minor_lock);
+
+	failed_put_cdev:
+	kobject_put(&h->cdev->kobj);
+
+	failed_free:
+	kfree(h);
+	return ret;
+}
+
+/**
+ * mmio_cdev_attach - Let the character device reach a fully registered bank.
+ *
+ * Until then, everything but open and close fails with -ENODEV.
+ */
+void mmio_cdev_attach(struct mmio_classdev *mmio_cdev)
+{
+	struct mmio_handle *h = mmio_cdev->handle;
+
+	down_write(&h->lock);
+	h->mmio_cdev = mmio_cdev;
+	up_write(&h->lock);
+}
+
+/**
+ * mmio_cdev_del - Remove a bank's character device and release its minor.
+ *
+ * Files the device is still open as, and their sessions, keep working but
+ * no longer reach the bank: sessions are stopped and everything else fails
+ * with -ENODEV. Waits for whoever is still using the bank.
+ */
+void mmio_cdev_del(struct mmio_classdev *mmio_cdev)
+{
+	struct mmio_handle *h = mmio_cdev->handle;
+
+	mutex_lock(&mmio_minor_lock);
+	idr_remove(&mmio_minor_idr, h->minor);
+	mutex_unlock(&mmio_minor_lock);
+	cdev_del(h->cdev);
+
+	down_write(&h->lock);
+	if (h->mmio_cdev)
+	{
+		mmio_sampler_detach(h);
+		mmio_event_detach(mmio_cdev);
+		h->mmio_cdev = NULL;
+	}
+	up_write(&h->lock);
+
+	mmio_cdev->handle = NULL;
+	mmio_handle_put(h);
+}
+
+static char *mmio_devnode(const struct device *dev, umode_t *mode)
+{
+	return kasprintf(GFP_KERNEL, "mmio/%s", dev_name(dev));
+}
+
+int mmio_cdev_init(void)
+{
+	int ret;
+
+	ret = alloc_chrdev_region(&mmio_devt, 0, MMIO_DEV_MAX, "mmio");
+	if (ret)
+		return ret;
+
+	mmio_class->devnode = mmio_devnode;
+	return 0;
+}
+
+void mmio_cdev_exit(void)
+{
+	unregister_chrdev_region(mmio_devt, MMIO_DEV_MAX);
+	idr_destroy(&mmio_minor_idr);
+}
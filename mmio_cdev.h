@@ -0,0 +1,40 @@
+#ifndef __MMIO_CDEV_H_INCLUDED
+#define __MMIO_CDEV_H_INCLUDED
+
+#include <linux/kref.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/rwsem.h>
+#include "mmio_internal.h"
+
+struct cdev;
+
+/*
+ * The character device of a bank, see mmio_cdev.c. Open files and the
+ * sessions created through them hold a reference to the handle rather than
+ * to the bank, which may be unregistered while they exist. mmio_cdev is only
+ * set between mmio_cdev_attach and mmio_cdev_del, which stops every session
+ * and subscription before clearing it, both under lock held for write, so
+ * whoever holds lock for read and finds mmio_cdev set may use the bank.
+ */
+struct mmio_handle {
+	struct kref           ref;
+	struct rw_semaphore   lock;
+	struct mmio_classdev  *mmio_cdev;     // NULL unless the bank is registered
+	struct cdev           *cdev;
+	int                   minor;
+	struct mutex          session_lock;   // Protects sessions
+	struct list_head      sessions;       // Sampler sessions not yet released
+};
+
+// mmio_cdev.c
+extern struct mmio_handle *mmio_handle_get(struct mmio_handle *h);
+extern void mmio_handle_put(struct mmio_handle *h);
+
+// mmio_sampler.c
+extern void mmio_sampler_detach(struct mmio_handle *h);
+
+// mmio_event.c
+extern void mmio_event_detach(struct mmio_classdev *mmio_cdev);
+
+#endif
@@ -0,0 +1,303 @@
+/*
+ * MMIO notification conditions
+ *
+ * Copyright (C) 2014 Joe Balough <jbb5044@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * A watched entry notifies every change by default, which is far too often
+ * for ADC readings or FIFO levels. With a condition attached, every value
+ * observed by a write, the poll or the interrupt is fed to it instead, and
+ * the entry is only notified when the condition goes from unmet to met:
+ *
+ *   above  value > threshold; unmet again once value <= threshold - hysteresis
+ *   below  value < threshold; unmet again once value >= threshold + hysteresis
+ *   rate   value differs by delta or more from the one samples observations ago
+ *   mask   (value & mask) == match
+ *
+ * Observations can come from any context but hard IRQ, see mmio_watch.c, so
+ * the conditions of a bank are protected by the watcher's cond_lock
+ * spinlock.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/device.h>
+#include <linux/overflow.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+#include "mmio_watch.h"
+
+struct mmio_cond_state {
+	struct mmio_condition  cond;
+	bool                   met;
+	unsigned int           len;     // Values in hist so far
+	unsigned int           pos;     // Oldest value once hist is full
+	u64                    hist[];  // The last cond.samples values, for rate
+};
+
+static const char * const mmio_cond_names[] = {
+	[MMIO_COND_NONE]  = "none",
+	[MMIO_COND_ABOVE] = "above",
+	[MMIO_COND_BELOW] = "below",
+	[MMIO_COND_RATE]  = "rate",
+	[MMIO_COND_MASK]  = "mask",
+};
+
+// Whether the condition is met after observing value; keeps the rate history
+static bool mmio_cond_test(struct mmio_cond_state *cs, u64 value)
+{
+	struct mmio_condition *c = &cs->cond;
+	u64 past;
+
+	switch (c->type)
+	{
+		case MMIO_COND_ABOVE:
+			if (value > c->threshold)
+				return true;
+			return cs->met && c->threshold - value < c->hysteresis;
+
+		case MMIO_COND_BELOW:
+			if (value < c->threshold)
+				return true;
+			return cs->met && value - c->threshold < c->hysteresis;
+
+		case MMIO_COND_RATE:
+			if (cs->len < c->samples)
+			{
+				cs->hist[cs->len++] = value;
+				return false;
+			}
+			past = cs->hist[cs->pos];
+			cs->hist[cs->pos] = value;
+			cs->pos = (cs->pos + 1) % c->samples;
+			return (value > past ? value - past : past - value) >= c->delta;
+
+		case MMIO_COND_MASK:
+			return (value & c->mask) == c->match;
+	}
+
+	return false;
+}
+
+/**
+ * mmio_cond_notify - Feed an observed value to an entry's condition
+ * @w     The bank's watcher
+ * @i     The entry's index
+ * @old   The value observed before
+ * @value The value observed now
+ *
+ * Returns whether to notify: on any change without a condition, when the
+ * condition becomes met with one.
+ */
+bool mmio_cond_notify(struct mmio_watcher *w, unsigned int i, u64 old, u64 value)
+{
+	struct mmio_cond_state *cs;
+	unsigned long irqflags;
+	bool ret = old != value, met;
+
+	if (!READ_ONCE(w->entries[i].cond))
+		return ret;
+
+	spin_lock_irqsave(&w->cond_lock, irqflags);
+	cs = w->entries[i].cond;
+	if (cs)
+	{
+		met = mmio_cond_test(cs, value);
+		ret = met && !cs->met;
+		cs->met = met;
+	}
+	spin_unlock_irqrestore(&w->cond_lock, irqflags);
+
+	return ret;
+}
+
+static int mmio_cond_validate(const struct mmio_condition *cond)
+{
+	switch (cond->type)
+	{
+		case MMIO_COND_ABOVE:
+		case MMIO_COND_BELOW:
+			return 0;
+		case MMIO_COND_RATE:
+			if (!cond->delta || !cond->samples || cond->samples > MMIO_COND_MAX_SAMPLES)
+				return -EINVAL;
+			return 0;
+		case MMIO_COND_MASK:
+			if (!cond->mask || (cond->match & ~cond->mask))
+				return -EINVAL;
+			return 0;
+	}
+	return -EINVAL;
+}
+
+/**
+ * mmio_watch_condition - Only notify an entry when a condition is met
+ * @parent The mmio_classdev bank containing the entry
+ * @entry  The mmio_entry
+ * @cond   The condition, NULL or MMIO_COND_NONE to notify every change again
+ *
+ * Applies to the entry's attribute, event fds and notifiers alike. The
+ * condition starts out evaluated against the entry's current value, so it
+ * only notifies once that changes.
+ */
+int mmio_watch_condition(struct mmio_classdev *parent, struct mmio_entry *entry,
+						 const struct mmio_condition *cond)
+{
+	struct mmio_cond_state *cs = NULL, *old;
+	struct mmio_watcher *w;
+	unsigned long irqflags;
+	int ret;
+
+	ret = mmio_watch_check(parent, entry);
+	if (ret)
+		return ret;
+	w = parent->watcher;
+
+	if (cond && cond->type != MMIO_COND_NONE)
+	{
+		ret = mmio_cond_validate(cond);
+		if (ret)
+			return ret;
+
+		cs = kzalloc(struct_size(cs, hist, cond->type == MMIO_COND_RATE ? cond->samples : 0),
+					 GFP_KERNEL);
+		if (!cs)
+			return -ENOMEM;
+		cs->cond = *cond;
+		cs->met = mmio_cond_test(cs, mmio_get_value(parent, entry));
+	}
+
+	spin_lock_irqsave(&w->cond_lock, irqflags);
+	old = w->entries[entry - parent->entries].cond;
+	w->entries[entry - parent->entries].cond = cs;
+	spin_unlock_irqrestore(&w->cond_lock, irqflags);
+
+	// Writes must be seen to keep the condition's state
+	if (cs && !old)
+		static_branch_inc(&mmio_notify_key);
+	else if (!cs && old)
+		static_branch_dec(&mmio_notify_key);
+	kfree(old);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(mmio_watch_condition);
+
+/**
+ * mmio_cond_show - Sysfs interface listing the conditions of a bank.
+ *
+ * One "<entry> <type> <arg> <arg>" line per entry with a condition, in the
+ * form mmio_cond_store takes.
+ */
+ssize_t mmio_cond_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	struct mmio_classdev *mmio_cdev = dev_get_drvdata(dev);
+	struct mmio_watcher *w = mmio_cdev->watcher;
+	struct mmio_condition *c;
+	unsigned long irqflags;
+	ssize_t len = 0;
+	u64 a, b;
+	unsigned int i;
+
+	spin_lock_irqsave(&w->cond_lock, irqflags);
+	for (i = 0; i < mmio_cdev->num_entries; i++)
+	{
+		if (!w->entries[i].cond)
+			continue;
+
+		c = &w->entries[i].cond->cond;
+		switch (c->type)
+		{
+			case MMIO_COND_RATE:
+				a = c->delta;
+				b = c->samples;
+				break;
+			case MMIO_COND_MASK:
+				a = c->mask;
+				b = c->match;
+				break;
+			default:
+				a = c->threshold;
+				b = c->hysteresis;
+				break;
+		}
+		if (c->type == MMIO_COND_MASK)
+			len += scnprintf(buf + len, PAGE_SIZE - len, "%s %s %#llx %#llx\n",
+							 mmio_cdev->entries[i].name, mmio_cond_names[c->type], a, b);
+		else
+			len += scnprintf(buf + len, PAGE_SIZE - len, "%s %s %llu %llu\n",
+							 mmio_cdev->entries[i].name, mmio_cond_names[c->type], a, b);
+	}
+	spin_unlock_irqrestore(&w->cond_lock, irqflags);
+
+	return len;
+}
+
+/**
+ * mmio_cond_store - Sysfs interface to set the condition of an entry.
+ *
+ * Takes "<entry> above|below <threshold> [<hysteresis>]",
+ * "<entry> rate <delta> <samples>", "<entry> mask <mask> <match>" or
+ * "<entry> none". Numbers may be decimal, 0x hex or 0 octal.
+ */
+ssize_t mmio_cond_store(struct device *dev, struct device_attribute *attr,
+						const char *buf, size_t size)
+{
+	struct mmio_classdev *mmio_cdev = dev_get_drvdata(dev);
+	struct mmio_condition cond = { };
+	struct mmio_entry *entry;
+	char name[MMIO_NAME_MAX], type[8], arg[2][24];
+	u64 a = 0, b = 0;
+	int n, ret;
+
+	// The widths follow MMIO_NAME_MAX, type and arg
+	n = sscanf(buf, "%31s %7s %23s %23s", name, type, arg[0], arg[1]);
+	if (n < 2)
+		return -EINVAL;
+	if ((n > 2 && kstrtou64(arg[0], 0, &a)) || (n > 3 && kstrtou64(arg[1], 0, &b)))
+		return -EINVAL;
+
+	entry = mmio_watch_find(mmio_cdev, name);
+	if (!entry)
+		return -ENOENT;
+
+	for (cond.type = 0; cond.type < ARRAY_SIZE(mmio_cond_names); cond.type++)
+		if (!strcmp(type, mmio_cond_names[cond.type]))
+			break;
+
+	switch (cond.type)
+	{
+		case MMIO_COND_NONE:
+			if (n != 2)
+				return -EINVAL;
+			break;
+		case MMIO_COND_ABOVE:
+		case MMIO_COND_BELOW:
+			if (n < 3)
+				return -EINVAL;
+			cond.threshold = a;
+			cond.hysteresis = b;
+			break;
+		case MMIO_COND_RATE:
+			if (n != 4 || b > MMIO_COND_MAX_SAMPLES)
+				return -EINVAL;
+			cond.delta = a;
+			cond.samples = b;
+			break;
+		case MMIO_COND_MASK:
+			if (n != 4)
+				return -EINVAL;
+			cond.mask = a;
+			cond.match = b;
+			break;
+		default:
+			return -EINVAL;
+	}
+
+	ret = mmio_watch_condition(mmio_cdev, entry, &cond);
+	return ret ? ret : size;
+}
@@ -0,0 +1,1349 @@
+/*
+ * MMIO
+ *
+ * Copyright (C) 2014 Joe Balough <jbb5044@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/module.h>
+#include <linux/device.h>
+#include <linux/io.h>
+#include <linux/rwsem.h>
+#include <linux/spinlock.h>
+#include <linux/err.h>
+#include <linux/slab.h>
+#include <linux/ctype.h>
+#include <linux/ktime.h>
+#include <net/sctp/command.h>
+#include "mmio_internal.h"
+
+#define CREATE_TRACE_POINTS
+#include "mmio_trace.h"
+
+DECLARE_RWSEM(mmio_list_lock);
+LIST_HEAD(mmio_list);
+
+struct class *mmio_class;
+
+DEFINE_STATIC_KEY_FALSE(mmio_stats_key);
+DEFINE_STATIC_KEY_FALSE(mmio_notify_key);
+
+
+/**
+ * mmio_lock_stats - mmio_lock that counts and times contended acquisitions
+ *
+ * Only the slow path reads the clock.
+ */
+static noinline unsigned long mmio_lock_stats(struct mmio_classdev *parent, struct mmio_reg *reg)
+{
+	unsigned long irqflags = 0;
+	u64 start;
+	
+	if (parent->flags & MMIO_BANK_ATOMIC)
+	{
+		if (raw_spin_trylock_irqsave(&reg->lock, irqflags))
+			return irqflags;
+	}
+	else if (down_write_trylock(&reg->rwsem))
+	{
+		return 0;
+	}
+	
+	start = ktime_get_ns();
+	if (parent->flags & MMIO_BANK_ATOMIC)
+		raw_spin_lock_irqsave(&reg->lock, irqflags);
+	else
+		down_write(&reg->rwsem);
+	
+	mmio_stats_inc(parent, contentions, 1);
+	mmio_stats_inc(parent, lock_wait_ns, ktime_get_ns() - start);
+	return irqflags;
+}
+
+/**
+ * mmio_lock - Lock one register of a bank for a read-modify-write
+ */
+static inline unsigned long mmio_lock(struct mmio_classdev *parent, struct mmio_reg *reg)
+{
+	unsigned long irqflags = 0;
+	
+	if (static_branch_unlikely(&mmio_stats_key))
+		return mmio_lock_stats(parent, reg);
+	
+	if (parent->flags & MMIO_BANK_ATOMIC)
+		raw_spin_lock_irqsave(&reg->lock, irqflags);
+	else
+		down_write(&reg->rwsem);
+	return irqflags;
+}
+
+static inline void mmio_unlock(struct mmio_classdev *parent, struct mmio_reg *reg,
+							   unsigned long irqflags)
+{
+	if (parent->flags & MMIO_BANK_ATOMIC)
+		raw_spin_unlock_irqrestore(&reg->lock, irqflags);
+	else
+		up_write(&reg->rwsem);
+}
+
+// Bus accessors for each register size, picked once by mmio_prepare
+static u64 mmio_readb(struct mmio_reg *reg)
+{
+	return __raw_readb(reg->addr);
+}
+
+static u64 mmio_readw(struct mmio_reg *reg)
+{
+	return __raw_readw(reg->addr);
+}
+
+static u64 mmio_readl(struct mmio_reg *reg)
+{
+	return __raw_readl(reg->addr);
+}
+
+static void mmio_writeb(struct mmio_reg *reg, u64 val)
+{
+	__raw_writeb((u8) val, reg->addr);
+}
+
+static void mmio_writew(struct mmio_reg *reg, u64 val)
+{
+	__raw_writew((u16) val, reg->addr);
+}
+
+static void mmio_writel(struct mmio_reg *reg, u64 val)
+{
+	__raw_writel((u32) val, reg->addr);
+}
+
+#ifdef CONFIG_64BIT
+static u64 mmio_readq(struct mmio_reg *reg)
+{
+	return __raw_readq(reg->addr);
+}
+
+static void mmio_writeq(struct mmio_reg *reg, u64 val)
+{
+	__raw_writeq(val, reg->addr);
+}
+#else
+/*
+ * Without a native 64-bit access the register is accessed as two 32-bit
+ * halves, low word first. The high word is read again until it is stable, so
+ * a carry out of the low word between the two reads can't give a torn value.
+ */
+static u64 mmio_readq(struct mmio_reg *reg)
+{
+	u32 lo, hi;
+	
+	do
+	{
+		hi = __raw_readl(reg->addr + 4);
+		lo = __raw_readl(reg->addr);
+	} while (hi != __raw_readl(reg->addr + 4));
+	
+	return ((u64) hi << 32) | lo;
+}
+
+static void mmio_writeq(struct mmio_reg *reg, u64 val)
+{
+	__raw_writel((u32) val, reg->addr);
+	__raw_writel((u32) (val >> 32), reg->addr + 4);
+}
+#endif
+
+// Accessors for banks that bring their own struct mmio_bus_ops
+static u64 mmio_ops_read(struct mmio_reg *reg)
+{
+	return reg->parent->ops->read(reg->parent, reg);
+}
+
+static void mmio_ops_write(struct mmio_reg *reg, u64 val)
+{
+	reg->parent->ops->write(reg->parent, reg, val);
+}
+
+/**
+ * mmio_init_reg - Set up one register of a bank
+ */
+static void mmio_init_reg(struct mmio_classdev *parent, struct mmio_reg *reg,
+						  unsigned int offset, u8 size)
+{
+	reg->parent = parent;
+	reg->offset = offset;
+	reg->size = size;
+	reg->addr = parent->base + parent->offset + offset;
+	switch(size)
+	{
+		case 1:
+			reg->write = mmio_writeb;
+			reg->read = mmio_readb;
+			break;
+		case 2:
+			reg->write = mmio_writew;
+			reg->read = mmio_readw;
+			break;
+		case 4:
+			reg->write = mmio_writel;
+			reg->read = mmio_readl;
+			break;
+		case 8:
+			reg->write = mmio_writeq;
+			reg->read = mmio_readq;
+			break;
+	}
+	if (parent->ops)
+	{
+		reg->write = mmio_ops_write;
+		reg->read = mmio_ops_read;
+	}
+	init_rwsem(&reg->rwsem);
+	raw_spin_lock_init(&reg->lock);
+}
+
+static inline u8 mmio_entry_size(struct mmio_classdev *parent, struct mmio_entry *entry)
+{
+	return entry->size ? entry->size : parent->size;
+}
+
+/**
+ * mmio_find_reg - Find the register at an offset among the first n of a bank
+ */
+static struct mmio_reg *mmio_find_reg(struct mmio_reg *regs, unsigned int n,
+									  unsigned int offset)
+{
+	unsigned int i;
+	
+	for (i = 0; i < n; i++)
+	{
+		if (regs[i].offset == offset)
+			return &regs[i];
+	}
+	return NULL;
+}
+
+static bool mmio_bank_attr_name(const char *name);
+
+/**
+ * mmio_prepare - Resolve everything the access paths need for a bank once
+ * @parent The mmio_classdev bank to prepare
+ *
+ * Validates the entries, groups them into one struct mmio_reg per register
+ * offset and precomputes each entry's shift and maximum value. Entries at
+ * the same offset must agree on the register's size, and registers may not
+ * overlap each other. Entries can't take the name of a bank attribute, whose
+ * sysfs files live in the same directory. Called by
+ * mmio_classdev_register, or on first use of a bank before registration, which
+ * must then happen from process context.
+ */
+static int mmio_prepare(struct mmio_classdev *parent)
+{
+	struct mmio_entry *entry, *other;
+	struct mmio_reg *regs, *reg;
+	unsigned int num_regs = 0, span = 0;
+	u8 size, other_size;
+	bool shared;
+	int i, j;
+	
+	if (parent->regs)
+		return 0;
+	
+	for (i = 0; i < parent->num_entries; i++)
+	{
+		entry = &(parent->entries[i]);
+		size = mmio_entry_size(parent, entry);
+		
+		if (size != 1 && size != 2 && size != 4 && size != 8)
+			return -EINVAL;
+		if ((unsigned long) (parent->base + parent->offset + entry->offset) & (size - 1))
+			return -EINVAL;
+		if (size < 8 && (entry->mask >> (size * 8)))
+			return -EINVAL;
+		if (entry->mask && entry->name && mmio_bank_attr_name(entry->name))
+		{
+			printk(KERN_ERR "%s: Entry %d of %s is named %s, which is reserved for the bank.\n",
+				   __FUNCTION__, i, parent->name, entry->name);
+			return -EINVAL;
+		}
+		
+		shared = false;
+		for (j = 0; j < i; j++)
+		{
+			other = &(parent->entries[j]);
+			other_size = mmio_entry_size(parent, other);
+			if (other->offset == entry->offset)
+			{
+				if (other_size != size)
+					return -EINVAL;
+				shared = true;
+			}
+			else if (other->offset < entry->offset + size &&
+					 entry->offset < other->offset + other_size)
+			{
+				return -EINVAL;
+			}
+		}
+		if (!shared)
+			num_regs++;
+		
+		span = max(span, entry->offset + size);
+	}
+	
+	regs = kcalloc(num_regs, sizeof(*regs), GFP_KERNEL);
+	if (!regs)
+		return -ENOMEM;
+	
+	num_regs = 0;
+	for (i = 0; i < parent->num_entries; i++)
+	{
+		entry = &(parent->entries[i]);
+		reg = mmio_find_reg(regs, num_regs, entry->offset);
+		if (!reg)
+		{
+			reg = &regs[num_regs++];
+			mmio_init_reg(parent, reg, entry->offset, mmio_entry_size(parent, entry));
+		}
+		
+		entry->reg = reg;
+		entry->shift = entry->mask ? __ffs64(entry->mask) : 0;
+		entry->max = entry->mask >> entry->shift;
+	}
+	
+	parent->num_regs = num_regs;
+	parent->span = span;
+	parent->regs = regs;
+	return 0;
+}
+
+/**
+ * mmio_release - Free what mmio_prepare allocated for a bank
+ */
+static void mmio_release(struct mmio_classdev *parent)
+{
+	kfree(parent->regs);
+	parent->regs = NULL;
+	parent->num_regs = 0;
+}
+
+static inline int mmio_ready(struct mmio_classdev *parent)
+{
+	if (likely(parent->regs))
+		return 0;
+	return mmio_prepare(parent);
+}
+
+/**
+ * mmio_account_bus - Count one timed bus access of a register
+ *
+ * Accesses slower than the bank's slow_threshold_us also fire the
+ * mmio_slow_access trace event.
+ */
+static void mmio_account_bus(struct mmio_reg *reg, bool write, u64 val, u64 ns)
+{
+	struct mmio_classdev *parent = reg->parent;
+	unsigned int bucket = mmio_hist_bucket(ns);
+	u64 threshold_ns = (u64) READ_ONCE(parent->slow_threshold_us) * NSEC_PER_USEC;
+	
+	if (write)
+	{
+		mmio_stats_inc(parent, bus_writes, 1);
+		mmio_stats_inc(parent, write_hist[bucket], 1);
+	}
+	else
+	{
+		mmio_stats_inc(parent, bus_reads, 1);
+		mmio_stats_inc(parent, read_hist[bucket], 1);
+	}
+	mmio_stats_inc(parent, bus_ns, ns);
+	
+	if (threshold_ns && ns > threshold_ns)
+		trace_mmio_slow_access(parent, reg, write, val, ns);
+}
+
+static noinline u64 mmio_read_reg_stats(struct mmio_reg *reg)
+{
+	u64 start = ktime_get_ns();
+	u64 val = reg->read(reg);
+	
+	mmio_account_bus(reg, false, val, ktime_get_ns() - start);
+	return val;
+}
+
+static noinline void mmio_write_reg_stats(struct mmio_reg *reg, u64 val)
+{
+	u64 start = ktime_get_ns();
+	
+	reg->write(reg, val);
+	mmio_account_bus(reg, true, val, ktime_get_ns() - start);
+}
+
+/**
+ * mmio_read_reg - Read a whole register from the bus
+ */
+static inline u64 mmio_read_reg(struct mmio_reg *reg)
+{
+	if (static_branch_unlikely(&mmio_stats_key))
+		return mmio_read_reg_stats(reg);
+	return reg->read(reg);
+}
+
+/**
+ * mmio_write_reg - Write a whole register to the bus
+ */
+static inline void mmio_write_reg(struct mmio_reg *reg, u64 val)
+{
+	if (static_branch_unlikely(&mmio_stats_key))
+		mmio_write_reg_stats(reg, val);
+	else
+		reg->write(reg, val);
+}
+
+static inline bool mmio_bank_cached(struct mmio_classdev *parent)
+{
+	return parent->flags & (MMIO_BANK_CACHED | MMIO_BANK_WRITE_ONLY);
+}
+
+/**
+ * mmio_read_is_atomic - Whether a bus read of a register needs no lock
+ *
+ * Registers are aligned, so an access no wider than the CPU's native word is
+ * a single bus transaction that can't observe half of a concurrent write.
+ */
+static inline bool mmio_read_is_atomic(struct mmio_classdev *parent, struct mmio_reg *reg)
+{
+	return reg->size <= sizeof(unsigned long) &&
+		   !(parent->flags & MMIO_BANK_READ_SIDE_EFFECTS);
+}
+
+/**
+ * mmio_read_never_sleeps - Whether mmio_get_value of an entry is usable in
+ * atomic context
+ *
+ * True for MMIO_BANK_ATOMIC banks, and for entries that are always read with
+ * a single lockless bus read.
+ */
+bool mmio_read_never_sleeps(struct mmio_classdev *parent, struct mmio_entry *entry)
+{
+	if (parent->flags & MMIO_BANK_ATOMIC)
+		return true;
+	if (mmio_bank_cached(parent) && !(entry->flags & MMIO_ENTRY_VOLATILE))
+		return false;
+	return mmio_read_is_atomic(parent, entry->reg);
+}
+
+/**
+ * mmio_fetch_reg - Get the current register value for a read-modify-write
+ *
+ * Cached banks return the shadow, loading it first if it is not valid.
+ * Must be called with the register locked.
+ */
+static u64 mmio_fetch_reg(struct mmio_classdev *parent, struct mmio_reg *reg)
+{
+	if (!mmio_bank_cached(parent))
+		return mmio_read_reg(reg);
+	
+	if (!reg->shadow_valid)
+	{
+		if (parent->flags & MMIO_BANK_WRITE_ONLY)
+			WRITE_ONCE(reg->shadow, parent->reset_value);
+		else
+			WRITE_ONCE(reg->shadow, mmio_read_reg(reg));
+		// Pairs with the lockless shadow read in mmio_get_value
+		smp_store_release(&reg->shadow_valid, true);
+	}
+	return reg->shadow;
+}
+
+/**
+ * mmio_store_reg - Write a register value and remember it in the shadow
+ *
+ * Must be called with the register locked.
+ */
+static void mmio_store_reg(struct mmio_classdev *parent, struct mmio_reg *reg, u64 val)
+{
+	mmio_write_reg(reg, val);
+	if (mmio_bank_cached(parent))
+		WRITE_ONCE(reg->shadow, val);
+}
+
+/**
+ * mmio_trace_start - Timestamp for the duration of a traced access
+ *
+ * Zero when the event is off, so the clock is only read while tracing.
+ */
+#define mmio_trace_start(event) (trace_##event##_enabled() ? ktime_get_ns() : 0)
+
+static inline u64 mmio_trace_duration(u64 start)
+{
+	return start ? ktime_get_ns() - start : 0;
+}
+
+/**
+ * mmio_encode_value - Shift a value into the position of an entry's mask
+ * @entry  The mmio_entry the value is for
+ * @value  The value to shift
+ * @field  Where to put the shifted value
+ *
+ * Returns -EOVERFLOW if the value does not fit in the entry, including when
+ * it has bits set in the gaps of a mask that isn't contiguous.
+ */
+static inline int mmio_encode_value(struct mmio_entry *entry, u64 value, u64 *field)
+{
+	*field = value << entry->shift;
+	if (value > entry->max || (*field & ~entry->mask))
+	{
+		if (static_branch_unlikely(&mmio_stats_key))
+			mmio_stats_inc(entry->reg->parent, overflows, 1);
+		return -EOVERFLOW;
+	}
+	return 0;
+}
+
+/*
+ * Entries of cached banks are read from the shadow unless they are
+ * MMIO_ENTRY_VOLATILE. Neither the shadow nor a single aligned bus read need
+ * the register's lock, so reads only take it on MMIO_BANK_READ_SIDE_EFFECTS
+ * banks or to load an invalid shadow.
+ */
+static __always_inline u64 mmio_load_reg(struct mmio_classdev *parent, struct mmio_reg *reg,
+										 bool shadow)
+{
+	unsigned long irqflags;
+	u64 val;
+
+	if (shadow)
+	{
+		// A 64-bit shadow can tear on 32-bit CPUs, read it under the lock
+		if (reg->size <= sizeof(unsigned long) && smp_load_acquire(&reg->shadow_valid))
+		{
+			val = READ_ONCE(reg->shadow);
+		}
+		else
+		{
+			irqflags = mmio_lock(parent, reg);
+			val = mmio_fetch_reg(parent, reg);
+			mmio_unlock(parent, reg, irqflags);
+		}
+	}
+	else if (mmio_read_is_atomic(parent, reg))
+	{
+		val = mmio_read_reg(reg);
+	}
+	else
+	{
+		// Reads with side effects must not overlap each other either
+		irqflags = mmio_lock(parent, reg);
+		val = mmio_read_reg(reg);
+		mmio_unlock(parent, reg, irqflags);
+	}
+
+	return val;
+}
+
+static __always_inline u64 __mmio_get_value(struct mmio_classdev *parent, struct mmio_entry *entry,
+											u64 *raw, bool bus, unsigned long caller)
+{
+	struct mmio_reg *reg;
+	u64 val, value, start;
+	if (! parent || !entry)
+	{
+		printk(KERN_ERR "%s: preventing null pointer deref. parent is 0x%p, entry is 0x%p\n", __FUNCTION__, parent, entry);
+		return 0;
+	}
+	if (mmio_ready(parent))
+	{
+		printk(KERN_ERR "%s: bank %s has invalid entries\n", __FUNCTION__, parent->name);
+		return 0;
+	}
+	reg = entry->reg;
+	start = mmio_trace_start(mmio_read);
+	val = mmio_load_reg(parent, reg, !bus && mmio_bank_cached(parent) &&
+						!(entry->flags & MMIO_ENTRY_VOLATILE));
+	
+	value = (val & entry->mask) >> entry->shift;
+	if (static_branch_unlikely(&mmio_stats_key))
+		mmio_stats_inc(parent, reads, 1);
+	if (trace_mmio_read_enabled())
+		trace_mmio_read(parent, entry, val, value, mmio_trace_duration(start), caller);
+	
+	if (raw)
+		*raw = val;
+	return value;
+}
+
+/**
+ * mmio_get_value - Internal mechanism to get the value of a register
+ * @parent The mmio_classdev bank containing the entry
+ * @entry  The mmio_entry to get
+ */
+u64 mmio_get_value(struct mmio_classdev *parent, struct mmio_entry *entry)
+{
+	return __mmio_get_value(parent, entry, NULL, false, _RET_IP_);
+}
+EXPORT_SYMBOL_GPL(mmio_get_value);
+
+/**
+ * mmio_get_value_raw - mmio_get_value that also returns the whole register
+ * @raw Where to store the register the entry's field was taken from
+ */
+u64 mmio_get_value_raw(struct mmio_classdev *parent, struct mmio_entry *entry, u64 *raw)
+{
+	return __mmio_get_value(parent, entry, raw, false, _RET_IP_);
+}
+
+/**
+ * mmio_get_value_bus - mmio_get_value that reads the bus even on cached banks
+ *
+ * The shadow is left alone. Not for MMIO_BANK_WRITE_ONLY banks.
+ */
+u64 mmio_get_value_bus(struct mmio_classdev *parent, struct mmio_entry *entry)
+{
+	return __mmio_get_value(parent, entry, NULL, true, _RET_IP_);
+}
+
+static inline bool mmio_entry_readable(struct mmio_entry *entry)
+{
+	return entry->mask && (entry->flags & MMIO_ENTRY_READ);
+}
+
+/**
+ * mmio_get_values - Read a range of entries, reading each register only once
+ * @parent The mmio_classdev bank containing the entries
+ * @first  Index of the first entry
+ * @count  Number of entries
+ * @values One value per entry, 0 for the ones that can't be read
+ *
+ * The entries of a register are all decoded from a single read of it, so
+ * they are consistent with each other, and only registers with a readable
+ * entry in the range are read at all. On cached banks a register is read
+ * from the bus if any of those entries is MMIO_ENTRY_VOLATILE. Registers are
+ * read one after the other, not under one lock.
+ */
+int mmio_get_values(struct mmio_classdev *parent, unsigned int first, unsigned int count,
+					u64 *values)
+{
+	struct mmio_entry *entry;
+	struct mmio_reg *reg;
+	bool needed, shadow;
+	u64 val, start;
+	int i, j, ret;
+
+	if (!parent || !values)
+		return -EINVAL;
+	if (first > parent->num_entries || count > parent->num_entries - first)
+		return -EINVAL;
+	ret = mmio_ready(parent);
+	if (ret)
+		return ret;
+
+	memset(values, 0, count * sizeof(*values));
+
+	for (i = 0; i < parent->num_regs; i++)
+	{
+		reg = &(parent->regs[i]);
+		needed = false;
+		shadow = mmio_bank_cached(parent);
+		for (j = 0; j < count; j++)
+		{
+			entry = &(parent->entries[first + j]);
+			if (entry->reg != reg || !mmio_entry_readable(entry))
+				continue;
+			needed = true;
+			if (entry->flags & MMIO_ENTRY_VOLATILE)
+				shadow = false;
+		}
+		if (!needed)
+			continue;
+
+		start = mmio_trace_start(mmio_read);
+		val = mmio_load_reg(parent, reg, shadow);
+
+		for (j = 0; j < count; j++)
+		{
+			entry = &(parent->entries[first + j]);
+			if (entry->reg != reg || !mmio_entry_readable(entry))
+				continue;
+			values[j] = (val & entry->mask) >> entry->shift;
+			if (static_branch_unlikely(&mmio_stats_key))
+				mmio_stats_inc(parent, reads, 1);
+			if (trace_mmio_read_enabled())
+				trace_mmio_read(parent, entry, val, values[j], mmio_trace_duration(start), _RET_IP_);
+		}
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(mmio_get_values);
+
+/**
+ * mmio_value_show - Sysfs interface to show the value of a register.
+ */
+static ssize_t mmio_value_show(struct device *dev, 
+							   struct device_attribute *attr, char *buf)
+{
+	struct mmio_classdev *mmio_cdev = dev_get_drvdata(dev);
+	struct mmio_entry *entry = container_of(attr, struct mmio_entry, attr);
+	u64 value;
+	
+	if (! (entry->flags & MMIO_ENTRY_READ) )
+		return -EPERM;
+	
+	value = mmio_get_value(mmio_cdev, entry);
+	
+	return sprintf(buf, "%llu\n", (unsigned long long) value);
+}
+
+static __always_inline int __mmio_set_value(struct mmio_classdev *parent, struct mmio_entry *entry,
+											u64 value, bool notify, unsigned long caller)
+{
+	struct mmio_reg *reg;
+	unsigned long irqflags;
+	u64 val, field, old, start;
+	int ret;
+	
+	if (!parent || !entry)
+		return -EINVAL;
+	ret = mmio_ready(parent);
+	if (ret)
+		return ret;
+	
+	ret = mmio_encode_value(entry, value, &field);
+	if (ret)
+		return ret;
+	
+	reg = entry->reg;
+	start = mmio_trace_start(mmio_write);
+	irqflags = mmio_lock(parent, reg);
+	
+	val = mmio_fetch_reg(parent, reg);
+	old = (val & entry->mask) >> entry->shift;
+	val &= ~entry->mask;
+	val |= field;
+	mmio_store_reg(parent, reg, val);
+	
+	mmio_unlock(parent, reg, irqflags);
+	
+	if (static_branch_unlikely(&mmio_stats_key))
+		mmio_stats_inc(parent, writes, 1);
+	if (trace_mmio_write_enabled())
+		trace_mmio_write(parent, entry, val, value, mmio_trace_duration(start), caller);
+	if (notify && static_branch_unlikely(&mmio_notify_key))
+		mmio_notify_write(parent, entry, old, value);
+	return 0;
+}
+
+/**
+ * mmio_set_value - Internal mechanism to set value to register
+ * @parent The mmio_classdev bank containing the entry
+ * @entry  The mmio_entry to modify
+ * @value  The value to set
+ */
+int mmio_set_value(struct mmio_classdev *parent, struct mmio_entry *entry, u64 value)
+{
+	return __mmio_set_value(parent, entry, value, true, _RET_IP_);
+}
+EXPORT_SYMBOL_GPL(mmio_set_value);
+
+/**
+ * mmio_get_value_atomic - Get the value of a register from atomic context
+ * @parent The MMIO_BANK_ATOMIC mmio_classdev bank containing the entry
+ * @entry  The mmio_entry to get
+ *
+ * Safe to call from hard IRQ context. Returns 0 for banks without
+ * MMIO_BANK_ATOMIC, whose lock may sleep.
+ */
+u64 mmio_get_value_atomic(struct mmio_classdev *parent, struct mmio_entry *entry)
+{
+	if (parent && WARN_ON_ONCE(!(parent->flags & MMIO_BANK_ATOMIC)))
+		return 0;
+
+	return __mmio_get_value(parent, entry, NULL, false, _RET_IP_);
+}
+EXPORT_SYMBOL_GPL(mmio_get_value_atomic);
+
+/**
+ * mmio_set_value_atomic - Set the value of a register from atomic context
+ * @parent The MMIO_BANK_ATOMIC mmio_classdev bank containing the entry
+ * @entry  The mmio_entry to modify
+ * @value  The value to set
+ *
+ * Safe to call from hard IRQ context. Fails with -EINVAL for banks without
+ * MMIO_BANK_ATOMIC, whose lock may sleep.
+ *
+ * The write is not notified: the attribute, event fds, notifiers and
+ * conditions use locks that sleep on PREEMPT_RT. A watched entry reports the
+ * change at its next poll instead.
+ */
+int mmio_set_value_atomic(struct mmio_classdev *parent, struct mmio_entry *entry, u64 value)
+{
+	if (parent && WARN_ON_ONCE(!(parent->flags & MMIO_BANK_ATOMIC)))
+		return -EINVAL;
+	
+	return __mmio_set_value(parent, entry, value, false, _RET_IP_);
+}
+EXPORT_SYMBOL_GPL(mmio_set_value_atomic);
+
+/**
+ * mmio_stage_value - Buffer a value for an entry until mmio_commit is called
+ * @parent The mmio_classdev bank containing the entry
+ * @entry  The mmio_entry to modify
+ * @value  The value to set
+ *
+ * Staging a value for an entry that already has one replaces it.
+ */
+int mmio_stage_value(struct mmio_classdev *parent, struct mmio_entry *entry, u64 value)
+{
+	struct mmio_reg *reg;
+	unsigned long irqflags;
+	u64 field;
+	int ret;
+	
+	if (!parent || !entry)
+		return -EINVAL;
+	ret = mmio_ready(parent);
+	if (ret)
+		return ret;
+	
+	ret = mmio_encode_value(entry, value, &field);
+	if (ret)
+		return ret;
+	
+	reg = entry->reg;
+	irqflags = mmio_lock(parent, reg);
+	reg->staged_mask |= entry->mask;
+	reg->staged_value &= ~entry->mask;
+	reg->staged_value |= field;
+	mmio_unlock(parent, reg, irqflags);
+	
+	return 0;
+}
+EXPORT_SYMBOL_GPL(mmio_stage_value);
+
+/**
+ * mmio_commit - Apply the staged values of a bank
+ * @parent The mmio_classdev bank to commit
+ *
+ * Each register with staged values gets a single read-modify-write. Each
+ * staged entry's write is then notified like one by mmio_set_value.
+ */
+int mmio_commit(struct mmio_classdev *parent)
+{
+	struct mmio_reg *reg;
+	struct mmio_entry *entry;
+	unsigned long irqflags;
+	u64 val, old, mask;
+	int i, j, ret;
+	
+	if (!parent)
+		return -EINVAL;
+	ret = mmio_ready(parent);
+	if (ret)
+		return ret;
+	
+	for (i = 0; i < parent->num_regs; i++)
+	{
+		reg = &(parent->regs[i]);
+		if (!READ_ONCE(reg->staged_mask))
+			continue;
+		
+		irqflags = mmio_lock(parent, reg);
+		mask = reg->staged_mask;
+		if (mask)
+		{
+			old = mmio_fetch_reg(parent, reg);
+			val = old & ~mask;
+			val |= reg->staged_value;
+			mmio_store_reg(parent, reg, val);
+			
+			reg->staged_mask = 0;
+			reg->staged_value = 0;
+		}
+		mmio_unlock(parent, reg, irqflags);
+		
+		if (!mask || !static_branch_unlikely(&mmio_notify_key))
+			continue;
+		for (j = 0; j < parent->num_entries; j++)
+		{
+			entry = &(parent->entries[j]);
+			if (entry->reg == reg && (entry->mask & mask))
+				mmio_notify_write(parent, entry, (old & entry->mask) >> entry->shift,
+								  (val & entry->mask) >> entry->shift);
+		}
+	}
+	
+	return 0;
+}
+EXPORT_SYMBOL_GPL(mmio_commit);
+
+/**
+ * mmio_abort - Drop every staged value of a bank
+ * @parent The mmio_classdev bank to abort
+ */
+void mmio_abort(struct mmio_classdev *parent)
+{
+	struct mmio_reg *reg;
+	unsigned long irqflags;
+	int i;
+	
+	if (!parent || !parent->regs)
+		return;
+	
+	for (i = 0; i < parent->num_regs; i++)
+	{
+		reg = &(parent->regs[i]);
+		irqflags = mmio_lock(parent, reg);
+		reg->staged_mask = 0;
+		reg->staged_value = 0;
+		mmio_unlock(parent, reg, irqflags);
+	}
+}
+EXPORT_SYMBOL_GPL(mmio_abort);
+
+/**
+ * mmio_sync - Reconcile the shadow of a cached bank with the hardware
+ * @parent The mmio_classdev bank to sync
+ *
+ * Reloads the shadow from the registers, or for MMIO_BANK_WRITE_ONLY banks
+ * writes the shadow out to the registers.
+ */
+int mmio_sync(struct mmio_classdev *parent)
+{
+	struct mmio_reg *reg;
+	unsigned long irqflags;
+	int i, ret;
+	
+	if (!parent)
+		return -EINVAL;
+	ret = mmio_ready(parent);
+	if (ret)
+		return ret;
+	if (!mmio_bank_cached(parent))
+		return 0;
+	
+	for (i = 0; i < parent->num_regs; i++)
+	{
+		reg = &(parent->regs[i]);
+		irqflags = mmio_lock(parent, reg);
+		if (parent->flags & MMIO_BANK_WRITE_ONLY)
+		{
+			mmio_write_reg(reg, mmio_fetch_reg(parent, reg));
+		}
+		else
+		{
+			WRITE_ONCE(reg->shadow, mmio_read_reg(reg));
+			smp_store_release(&reg->shadow_valid, true);
+		}
+		mmio_unlock(parent, reg, irqflags);
+	}
+	
+	return 0;
+}
+EXPORT_SYMBOL_GPL(mmio_sync);
+
+/**
+ * mmio_invalidate - Forget the shadow of a cached bank
+ * @parent The mmio_classdev bank to invalidate
+ *
+ * The next access reloads the shadow from the register, or from reset_value
+ * for MMIO_BANK_WRITE_ONLY banks. Use it after the hardware was reset or
+ * changed behind the driver's back.
+ */
+void mmio_invalidate(struct mmio_classdev *parent)
+{
+	struct mmio_reg *reg;
+	unsigned long irqflags;
+	int i;
+	
+	if (!parent || !parent->regs)
+		return;
+	
+	for (i = 0; i < parent->num_regs; i++)
+	{
+		reg = &(parent->regs[i]);
+		irqflags = mmio_lock(parent, reg);
+		WRITE_ONCE(reg->shadow_valid, false);
+		mmio_unlock(parent, reg, irqflags);
+	}
+}
+EXPORT_SYMBOL_GPL(mmio_invalidate);
+
+/**
+ * mmio_value_store - Sysfs interface to store a value to a register.
+ *
+ * On banks with MMIO_BANK_STAGED the value is only staged; it reaches the
+ * register when "commit" is written.
+ */
+static ssize_t mmio_value_store(struct device *dev,
+								struct device_attribute *attr, const char *buf, size_t size)
+{
+	int r;
+	struct mmio_classdev *mmio_cdev = dev_get_drvdata(dev);
+	struct mmio_entry *entry = container_of(attr, struct mmio_entry, attr);
+	ssize_t ret = -EINVAL;
+	char *after;
+	u64 state = simple_strtoull(buf, &after, 10);
+	size_t count = after - buf;
+	
+	if (! (entry->flags & MMIO_ENTRY_WRITE) )
+		return -EPERM;
+	
+	if (isspace(*after))
+		count++;
+	
+	if (count == size) {
+		ret = count;
+		
+		if (mmio_cdev->flags & MMIO_BANK_STAGED)
+			r = mmio_stage_value(mmio_cdev, entry, state);
+		else
+			r = mmio_set_value(mmio_cdev, entry, state);
+		if (r < 0) ret = r;
+	}
+	
+	return ret;
+}
+
+/**
+ * commit_store - Sysfs interface to apply the staged values of a bank.
+ */
+static ssize_t commit_store(struct device *dev,
+							struct device_attribute *attr, const char *buf, size_t size)
+{
+	struct mmio_classdev *mmio_cdev = dev_get_drvdata(dev);
+	bool commit;
+	int ret;
+	
+	ret = kstrtobool(buf, &commit);
+	if (ret)
+		return ret;
+	if (!commit)
+		return -EINVAL;
+	
+	ret = mmio_commit(mmio_cdev);
+	return ret ? ret : size;
+}
+static DEVICE_ATTR_WO(commit);
+
+/**
+ * abort_store - Sysfs interface to drop the staged values of a bank.
+ */
+static ssize_t abort_store(struct device *dev,
+						   struct device_attribute *attr, const char *buf, size_t size)
+{
+	struct mmio_classdev *mmio_cdev = dev_get_drvdata(dev);
+	bool abort;
+	int ret;
+	
+	ret = kstrtobool(buf, &abort);
+	if (ret)
+		return ret;
+	if (!abort)
+		return -EINVAL;
+	
+	mmio_abort(mmio_cdev);
+	return size;
+}
+static DEVICE_ATTR_WO(abort);
+
+/**
+ * sync_store - Sysfs interface to reconcile the shadow of a bank.
+ */
+static ssize_t sync_store(struct device *dev,
+						  struct device_attribute *attr, const char *buf, size_t size)
+{
+	struct mmio_classdev *mmio_cdev = dev_get_drvdata(dev);
+	bool sync;
+	int ret;
+	
+	ret = kstrtobool(buf, &sync);
+	if (ret)
+		return ret;
+	if (!sync)
+		return -EINVAL;
+	
+	ret = mmio_sync(mmio_cdev);
+	return ret ? ret : size;
+}
+static DEVICE_ATTR_WO(sync);
+
+/**
+ * invalidate_store - Sysfs interface to forget the shadow of a bank.
+ */
+static ssize_t invalidate_store(struct device *dev,
+								struct device_attribute *attr, const char *buf, size_t size)
+{
+	struct mmio_classdev *mmio_cdev = dev_get_drvdata(dev);
+	bool invalidate;
+	int ret;
+	
+	ret = kstrtobool(buf, &invalidate);
+	if (ret)
+		return ret;
+	if (!invalidate)
+		return -EINVAL;
+	
+	mmio_invalidate(mmio_cdev);
+	return size;
+}
+static DEVICE_ATTR_WO(invalidate);
+
+/**
+ * dump_show - Sysfs interface showing every readable entry of a bank.
+ *
+ * One "<entry>=<value>" line per entry, all from a single mmio_get_values.
+ */
+static ssize_t dump_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	struct mmio_classdev *mmio_cdev = dev_get_drvdata(dev);
+	ssize_t len = 0;
+	u64 *values;
+	int i, ret;
+
+	values = kmalloc_array(mmio_cdev->num_entries, sizeof(*values), GFP_KERNEL);
+	if (!values)
+		return -ENOMEM;
+
+	ret = mmio_get_values(mmio_cdev, 0, mmio_cdev->num_entries, values);
+	if (ret)
+	{
+		kfree(values);
+		return ret;
+	}
+
+	for (i = 0; i < mmio_cdev->num_entries; i++)
+		if (mmio_entry_readable(&(mmio_cdev->entries[i])))
+			len += scnprintf(buf + len, PAGE_SIZE - len, "%s=%llu\n", mmio_cdev->entries[i].name,
+							 (unsigned long long) values[i]);
+
+	kfree(values);
+	return len;
+}
+static DEVICE_ATTR_RO(dump);
+
+// See mmio_watch.c, mmio_cond.c and mmio_wait.c
+static DEVICE_ATTR(watch, 0644, mmio_watch_show, mmio_watch_store);
+static DEVICE_ATTR(condition, 0644, mmio_cond_show, mmio_cond_store);
+static DEVICE_ATTR(wait, 0200, NULL, mmio_wait_store);
+
+static struct attribute *mmio_bank_attrs[] = {
+	&dev_attr_commit.attr,
+	&dev_attr_abort.attr,
+	&dev_attr_sync.attr,
+	&dev_attr_invalidate.attr,
+	&dev_attr_watch.attr,
+	&dev_attr_condition.attr,
+	&dev_attr_wait.attr,
+	&dev_attr_dump.attr,
+	NULL,
+};
+
+/**
+ * mmio_bank_attr_visible - Only show the bank attributes its flags ask for.
+ */
+static umode_t mmio_bank_attr_visible(struct kobject *kobj, struct attribute *attr, int n)
+{
+	struct mmio_classdev *mmio_cdev = dev_get_drvdata(kobj_to_dev(kobj));
+	
+	if (attr == &dev_attr_commit.attr || attr == &dev_attr_abort.attr)
+		return (mmio_cdev->flags & MMIO_BANK_STAGED) ? attr->mode : 0;
+	if (attr == &dev_attr_sync.attr || attr == &dev_attr_invalidate.attr)
+		return mmio_bank_cached(mmio_cdev) ? attr->mode : 0;
+	
+	return attr->mode;
+}
+
+static const struct attribute_group mmio_bank_group = {
+	.attrs      = mmio_bank_attrs,
+	.is_visible = mmio_bank_attr_visible,
+};
+
+/**
+ * mmio_bank_attr_name - Whether a name is taken by one of the bank attributes
+ *
+ * Whether or not the bank shows it, so that its entries can keep their names
+ * whatever flags it is given.
+ */
+static bool mmio_bank_attr_name(const char *name)
+{
+	int i;
+	
+	for (i = 0; mmio_bank_attrs[i]; i++)
+		if (!strcmp(mmio_bank_attrs[i]->name, name))
+			return true;
+	return false;
+}
+
+/**
+ * mmio_classdev_register - register a new object of the mmio_classdev class.
+ * @parent: The device to register
+ * @mmio_cdev: The mmio_classdev structure for this device
+ */
+int mmio_classdev_register(struct device *parent, struct mmio_classdev *mmio_cdev)
+{
+	int i, ret;
+	bool prepared;
+	dev_t devt;
+	if (!mmio_cdev->base || !mmio_cdev->entries || !mmio_cdev->name)
+		return -EINVAL;
+	if (mmio_cdev->size != 1 && mmio_cdev->size != 2 && mmio_cdev->size != 4 && mmio_cdev->size != 8)
+		return -EINVAL;
+	
+	// Keep the registers of a bank that was already used before registration
+	prepared = mmio_cdev->regs != NULL;
+	ret = mmio_prepare(mmio_cdev);
+	if (ret)
+		return ret;
+	
+	// Before any access can count into the statistics, freed after the last
+	ret = mmio_debugfs_add(mmio_cdev);
+	if (ret)
+		goto failed_release;
+	
+	ret = mmio_cdev_add(mmio_cdev, &devt);
+	if (ret)
+		goto failed_debugfs_del;
+	
+	mmio_cdev->dev = device_create(mmio_class, parent, devt, mmio_cdev,
+								   "%s", mmio_cdev->name);
+	if (IS_ERR(mmio_cdev->dev))
+	{
+		ret = PTR_ERR(mmio_cdev->dev);
+		mmio_cdev->dev = NULL;
+		goto failed_del_cdev;
+	}
+	
+	for (i = 0; i < mmio_cdev->num_entries; i++)
+	{
+		if (!mmio_cdev->entries[i].mask)
+		{
+			printk(KERN_INFO "%s: Skipping entry %d (%s), mask is zero.\n", __FUNCTION__, i, mmio_cdev->entries[i].name);
+			continue;
+		}
+		mmio_cdev->entries[i].attr.attr.name = mmio_cdev->entries[i].name;
+		mmio_cdev->entries[i].attr.attr.mode = 0644;
+		mmio_cdev->entries[i].attr.show = mmio_value_show;
+		mmio_cdev->entries[i].attr.store = mmio_value_store;
+		
+		ret = device_create_file(mmio_cdev->dev, &(mmio_cdev->entries[i].attr));
+		if (ret) {
+			printk(KERN_ERR "%s: Failed to add sysfs file %s\n", __FUNCTION__, mmio_cdev->entries[i].name);
+			dev_err(mmio_cdev->dev, "failed: sysfs file %s\n", mmio_cdev->entries[i].name);
+			goto failed_unregister_dev_file;
+		}
+	}
+	
+	// Before the "watch" file can be used
+	ret = mmio_watch_add(mmio_cdev);
+	if (ret)
+		goto failed_unregister_dev_file;
+	
+	ret = sysfs_create_group(&mmio_cdev->dev->kobj, &mmio_bank_group);
+	if (ret)
+		goto failed_watch_del;
+	
+	// add to the list of mmio devices
+	down_write(&mmio_list_lock);
+	list_add_tail(&mmio_cdev->node, &mmio_list);
+	up_write(&mmio_list_lock);
+	
+	mmio_cdev_attach(mmio_cdev);
+	
+	printk(KERN_INFO "Registered mmio device \"%s\" at 0x%p, offset 0x%x, %u registers, size %d B.\n",
+		   mmio_cdev->name, mmio_cdev->base, mmio_cdev->offset, mmio_cdev->num_regs, mmio_cdev->size);
+	
+	return 0;
+	
+	failed_watch_del:
+	mmio_watch_del(mmio_cdev);
+	
+	failed_unregister_dev_file:
+	for (i--; i >= 0; i--)
+		device_remove_file(mmio_cdev->dev, &(mmio_cdev->entries[i].attr));
+	device_unregister(mmio_cdev->dev);
+	mmio_cdev->dev = NULL;
+	
+	failed_del_cdev:
+	mmio_cdev_del(mmio_cdev);
+	
+	failed_debugfs_del:
+	mmio_debugfs_del(mmio_cdev);
+	
+	failed_release:
+	if (!prepared)
+		mmio_release(mmio_cdev);
+	
+	return ret;
+}
+EXPORT_SYMBOL_GPL(mmio_classdev_register);
+
+/**
+ * mmio_classdev_unregister - unregisters a object of mmio_classdev class.
+ * @mmio_cdev: the mmio device to unregister
+ *
+ * Unregisters a previously registered via led_classdev_register object.
+ * The bank may be freed once this returns, even if its character device is
+ * still open.
+ */
+void mmio_classdev_unregister(struct mmio_classdev *mmio_cdev)
+{
+	int i;
+	// First, so that nothing started through it outlives the bank
+	mmio_cdev_del(mmio_cdev);
+	
+	for (i = 0; i < mmio_cdev->num_entries; i++)
+	{
+		device_remove_file(mmio_cdev->dev, &(mmio_cdev->entries[i].attr));
+	}
+	sysfs_remove_group(&mmio_cdev->dev->kobj, &mmio_bank_group);
+	mmio_watch_del(mmio_cdev);
+	
+	device_unregister(mmio_cdev->dev);
+	
+	down_write(&mmio_list_lock);
+	list_del(&mmio_cdev->node);
+	up_write(&mmio_list_lock);
+	
+	// Last, nothing can reach the bank's accessors and count into them anymore
+	mmio_debugfs_del(mmio_cdev);
+	mmio_release(mmio_cdev);
+}
+EXPORT_SYMBOL_GPL(mmio_classdev_unregister);
+
+static int __init mmio_init(void)
+{
+	int ret;
+	
+	mmio_class = class_create("mmio");
+	if (IS_ERR(mmio_class))
+		return PTR_ERR(mmio_class);
+	
+	ret = mmio_cdev_init();
+	if (ret)
+	{
+		class_destroy(mmio_class);
+		return ret;
+	}
+	
+	mmio_debugfs_init();
+	return 0;
+}
+
+static void __exit mmio_exit(void)
+{
+	mmio_debugfs_exit();
+	mmio_cdev_exit();
+	class_destroy(mmio_class);
+}
+
+subsys_initcall(mmio_init);
+module_exit(mmio_exit);
+
+MODULE_AUTHOR("Joe Balough <jbb5044@gmail.com>");
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("MMIO Class Interface");
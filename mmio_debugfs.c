@@ -0,0 +1,203 @@
+/*
+ * MMIO debugfs interface
+ *
+ * Copyright (C) 2014 Joe Balough <jbb5044@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * debugfs/mmio/stats_enabled switches the access counters of every bank on
+ * or off. Each bank gets a debugfs/mmio/<name> directory with:
+ *
+ *   stats          One "<counter> <value>" line per counter of struct
+ *                  mmio_stats, summed over all CPUs
+ *   read_latency   Log2 histograms of bus access times, one "<from_ns>
+ *   write_latency  <to_ns> <count>" line per non-empty bucket, where the
+ *                  last bucket's to_ns is "inf"
+ *   reset          Write anything to zero the counters and histograms
+ *   slow_threshold_us
+ *                  Fire the mmio_slow_access trace event for any bus
+ *                  access slower than this; 0 turns it off
+ *
+ * Nothing is counted or traced as slow unless stats_enabled is on.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/debugfs.h>
+#include <linux/fs.h>
+#include <linux/seq_file.h>
+#include <linux/string.h>
+#include "mmio_internal.h"
+
+static bool stats;
+module_param(stats, bool, 0444);
+MODULE_PARM_DESC(stats, "Keep access statistics from boot, see debugfs/mmio/stats_enabled");
+
+static struct dentry *mmio_debugfs_root;
+
+#define MMIO_STAT(_name) { #_name, offsetof(struct mmio_stats, _name) }
+
+static const struct {
+	const char  *name;
+	size_t      offset;
+} mmio_stats_fields[] = {
+	MMIO_STAT(reads),
+	MMIO_STAT(writes),
+	MMIO_STAT(overflows),
+	MMIO_STAT(bus_reads),
+	MMIO_STAT(bus_writes),
+	MMIO_STAT(bus_ns),
+	MMIO_STAT(contentions),
+	MMIO_STAT(lock_wait_ns),
+};
+
+static int mmio_stats_show(struct seq_file *s, void *unused)
+{
+	struct mmio_classdev *mmio_cdev = s->private;
+	u64 sum;
+	int i, cpu;
+
+	for (i = 0; i < ARRAY_SIZE(mmio_stats_fields); i++)
+	{
+		sum = 0;
+		for_each_possible_cpu(cpu)
+			sum += READ_ONCE(*(u64 *) ((void *) per_cpu_ptr(mmio_cdev->stats, cpu) +
+									   mmio_stats_fields[i].offset));
+		seq_printf(s, "%s %llu\n", mmio_stats_fields[i].name, sum);
+	}
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(mmio_stats);
+
+static void mmio_hist_show(struct seq_file *s, size_t offset)
+{
+	struct mmio_classdev *mmio_cdev = s->private;
+	u64 *hist, count;
+	int b, cpu;
+
+	for (b = 0; b < MMIO_HIST_BUCKETS; b++)
+	{
+		count = 0;
+		for_each_possible_cpu(cpu)
+		{
+			hist = (void *) per_cpu_ptr(mmio_cdev->stats, cpu) + offset;
+			count += READ_ONCE(hist[b]);
+		}
+		if (!count)
+			continue;
+
+		seq_printf(s, "%llu ", b ? 1ULL << (b - 1) : 0);
+		if (b == MMIO_HIST_BUCKETS - 1)
+			seq_puts(s, "inf");
+		else
+			seq_printf(s, "%llu", 1ULL << b);
+		seq_printf(s, " %llu\n", count);
+	}
+}
+
+static int mmio_read_latency_show(struct seq_file *s, void *unused)
+{
+	mmio_hist_show(s, offsetof(struct mmio_stats, read_hist));
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(mmio_read_latency);
+
+static int mmio_write_latency_show(struct seq_file *s, void *unused)
+{
+	mmio_hist_show(s, offsetof(struct mmio_stats, write_hist));
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(mmio_write_latency);
+
+/*
+ * Counters updated on other CPUs while this runs may keep their last
+ * increment; good enough for statistics.
+ */
+static ssize_t mmio_stats_reset_write(struct file *file, const char __user *buf,
+									  size_t count, loff_t *ppos)
+{
+	struct mmio_classdev *mmio_cdev = file->private_data;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(mmio_cdev->stats, cpu), 0, sizeof(struct mmio_stats));
+
+	return count;
+}
+
+static const struct file_operations mmio_stats_reset_fops = {
+	.owner  = THIS_MODULE,
+	.open   = simple_open,
+	.write  = mmio_stats_reset_write,
+	.llseek = noop_llseek,
+};
+
+static int mmio_stats_enabled_get(void *data, u64 *val)
+{
+	*val = static_key_enabled(&mmio_stats_key);
+	return 0;
+}
+
+static int mmio_stats_enabled_set(void *data, u64 val)
+{
+	if (val)
+		static_branch_enable(&mmio_stats_key);
+	else
+		static_branch_disable(&mmio_stats_key);
+	return 0;
+}
+DEFINE_DEBUGFS_ATTRIBUTE(mmio_stats_enabled_fops, mmio_stats_enabled_get,
+						 mmio_stats_enabled_set, "%llu\n");
+
+/**
+ * mmio_debugfs_add - Allocate a bank's counters and create its directory.
+ *
+ * Only failing to allocate the counters is an error; like everywhere else,
+ * a missing debugfs just means the files aren't there.
+ */
+int mmio_debugfs_add(struct mmio_classdev *mmio_cdev)
+{
+	mmio_cdev->stats = alloc_percpu(struct mmio_stats);
+	if (!mmio_cdev->stats)
+		return -ENOMEM;
+
+	mmio_cdev->debugfs = debugfs_create_dir(mmio_cdev->name, mmio_debugfs_root);
+	debugfs_create_file("stats", 0444, mmio_cdev->debugfs, mmio_cdev, &mmio_stats_fops);
+	debugfs_create_file("read_latency", 0444, mmio_cdev->debugfs, mmio_cdev,
+						&mmio_read_latency_fops);
+	debugfs_create_file("write_latency", 0444, mmio_cdev->debugfs, mmio_cdev,
+						&mmio_write_latency_fops);
+	debugfs_create_file("reset", 0200, mmio_cdev->debugfs, mmio_cdev, &mmio_stats_reset_fops);
+	debugfs_create_u32("slow_threshold_us", 0644, mmio_cdev->debugfs,
+					   &mmio_cdev->slow_threshold_us);
+
+	return 0;
+}
+
+void mmio_debugfs_del(struct mmio_classdev *mmio_cdev)
+{
+	debugfs_remove_recursive(mmio_cdev->debugfs);
+	mmio_cdev->debugfs = NULL;
+
+	free_percpu(mmio_cdev->stats);
+	mmio_cdev->stats = NULL;
+}
+
+void mmio_debugfs_init(void)
+{
+	mmio_debugfs_root = debugfs_create_dir("mmio", NULL);
+	debugfs_create_file_unsafe("stats_enabled", 0644, mmio_debugfs_root, NULL,
+							   &mmio_stats_enabled_fops);
+
+	if (stats)
+		static_branch_enable(&mmio_stats_key);
+}
+
+void mmio_debugfs_exit(void)
+{
+	debugfs_remove_recursive(mmio_debugfs_root);
+	mmio_debugfs_root = NULL;
+}
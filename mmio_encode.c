@@ -0,0 +1,127 @@
+/*
+ * MMIO compressed sample encoder
+ *
+ * Copyright (C) 2014 Joe Balough <jbb5044@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Writes the MMIO_SAMPLE_COMPRESSED stream described in mmio_ioctl.h.
+ * Status registers rarely change, so most ticks only extend a run and cost
+ * nothing until the run is written out. Ticks that don't fit are counted and
+ * written as a skip later; the decoder's state is only ever advanced by what
+ * was actually written, so a skip never corrupts the values that follow.
+ *
+ * No locking: the encoder belongs to one sampler and only runs from its timer.
+ */
+
+#include <linux/kernel.h>
+#include "mmio_internal.h"
+
+static u64 mmio_encode_room(struct mmio_encoder *enc, u64 tail)
+{
+	u64 used = enc->head - tail;
+
+	// tail comes from the reader, who may have stored anything
+	return used > (u64) enc->mask + 1 ? 0 : (u64) enc->mask + 1 - used;
+}
+
+static void mmio_encode_varint(struct mmio_encoder *enc, u64 x)
+{
+	while (x >= 0x80)
+	{
+		enc->data[enc->head++ & enc->mask] = x | 0x80;
+		x >>= 7;
+	}
+	enc->data[enc->head++ & enc->mask] = x;
+}
+
+static void mmio_encode_item(struct mmio_encoder *enc, unsigned int type, u64 x)
+{
+	mmio_encode_varint(enc, x << 2 | type);
+}
+
+// Write the pending run, then the pending skip; the run always came first
+static void mmio_encode_pending(struct mmio_encoder *enc)
+{
+	if (enc->run)
+	{
+		mmio_encode_item(enc, MMIO_ITEM_RUN, enc->run);
+		mmio_encode_varint(enc, enc->run_time - enc->time);
+		enc->time = enc->run_time;
+		enc->run = 0;
+	}
+	if (enc->skipped)
+	{
+		mmio_encode_item(enc, MMIO_ITEM_SKIP, enc->skipped);
+		enc->skipped = 0;
+	}
+}
+
+/**
+ * mmio_encode_tick - Add a tick to the stream
+ * @enc    The encoder
+ * @tail   The reader's position; nothing at or after it is overwritten
+ * @time   The tick's timestamp
+ * @values One value per sampled entry
+ *
+ * Returns false if the tick was dropped for lack of room.
+ */
+bool mmio_encode_tick(struct mmio_encoder *enc, u64 tail, u64 time, const u64 *values)
+{
+	u64 changed = 0;
+	unsigned int i;
+
+	for (i = 0; i < enc->count; i++)
+		if (values[i] != enc->values[i])
+			changed |= 1ULL << i;
+
+	// Runs can't continue across a skip, the decoder would misplace them
+	if (!changed && !enc->skipped && enc->run < MMIO_SAMPLE_MAX_RUN)
+	{
+		enc->run++;
+		enc->run_time = time;
+		return true;
+	}
+
+	if (mmio_encode_room(enc, tail) < MMIO_ENCODE_MAX_BYTES(enc->count))
+	{
+		enc->skipped++;
+		return false;
+	}
+	mmio_encode_pending(enc);
+
+	// A full run or the first tick after a skip starts a new run
+	if (!changed)
+	{
+		enc->run = 1;
+		enc->run_time = time;
+		return true;
+	}
+
+	mmio_encode_item(enc, MMIO_ITEM_TICK, time - enc->time);
+	mmio_encode_varint(enc, changed);
+	for (i = 0; i < enc->count; i++)
+	{
+		if (changed & (1ULL << i))
+		{
+			mmio_encode_varint(enc, values[i] ^ enc->values[i]);
+			enc->values[i] = values[i];
+		}
+	}
+	enc->time = time;
+
+	return true;
+}
+
+/**
+ * mmio_encode_flush - Write out any pending run or skip if there's room
+ * @enc  The encoder
+ * @tail The reader's position
+ */
+void mmio_encode_flush(struct mmio_encoder *enc, u64 tail)
+{
+	if ((enc->run || enc->skipped) && mmio_encode_room(enc, tail) >= MMIO_ENCODE_MAX_BYTES(0))
+		mmio_encode_pending(enc);
+}
@@ -0,0 +1,478 @@
+/*
+ * MMIO change event streams
+ *
+ * Copyright (C) 2014 Joe Balough <jbb5044@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * MMIO_IOC_SUBSCRIBE hands out event fds, each with its own queue of struct
+ * mmio_event. An fd has one subscription per bank it follows, holding a
+ * bitmap of the entries it wants and linked into the bank's event_subs, so
+ * a change is only queued, and a reader only woken, where it was asked for.
+ *
+ * mmio_event_post may run in any context but hard IRQ, see mmio_watch.c, so
+ * the bank's event_lock and the queue's lock are spinlocks, taken in that
+ * order. Subscriptions are only
+ * freed after being unlinked under event_lock, which posting holds for the
+ * whole walk of the list.
+ *
+ * A subscription holds its bank's handle, see mmio_cdev.h, and only touches
+ * the bank with the handle's lock held. When the bank is unregistered,
+ * mmio_event_detach unlinks its subscriptions for good. A queue left with no
+ * linked subscriptions that way is dead: once drained, read() returns 0.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/anon_inodes.h>
+#include <linux/bitmap.h>
+#include <linux/err.h>
+#include <linux/file.h>
+#include <linux/fs.h>
+#include <linux/ktime.h>
+#include <linux/poll.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <linux/wait.h>
+#include "mmio_cdev.h"
+#include "mmio_watch.h"
+#include "mmio_ioctl.h"
+
+struct mmio_event_queue {
+	spinlock_t           lock;      // Protects the queue itself
+	struct mmio_event    *events;
+	unsigned int         size;
+	unsigned int         head;      // Oldest event
+	unsigned int         count;
+	u32                  dropped;   // Not yet reported in an event
+	unsigned int         linked;    // Subscriptions in their bank's event_subs
+	bool                 dead;      // The last of them was detached
+	wait_queue_head_t    wait;
+	struct mutex         sub_lock;  // Protects subs
+	struct list_head     subs;
+};
+
+struct mmio_event_sub {
+	struct list_head         bank_node;   // In the bank's event_subs
+	struct list_head         queue_node;  // In the queue's subs
+	struct mmio_event_queue  *queue;
+	struct mmio_classdev     *mmio_cdev;
+	struct mmio_handle       *handle;     // The bank's, held
+	bool                     detached;    // Under the handle's lock
+	u32                      cookie;
+	unsigned long            entries[];   // Bitmap of entry indexes
+};
+
+static void mmio_event_push(struct mmio_event_queue *q, struct mmio_event *ev)
+{
+	unsigned long irqflags;
+	bool queued = false;
+
+	spin_lock_irqsave(&q->lock, irqflags);
+	if (q->count == q->size)
+	{
+		q->dropped++;
+	}
+	else
+	{
+		ev->dropped = q->dropped;
+		q->events[(q->head + q->count) % q->size] = *ev;
+		q->count++;
+		q->dropped = 0;
+		queued = true;
+	}
+	spin_unlock_irqrestore(&q->lock, irqflags);
+
+	if (queued)
+		wake_up_interruptible_poll(&q->wait, EPOLLIN | EPOLLRDNORM);
+}
+
+/**
+ * mmio_event_post - Queue a change for every event fd subscribed to the entry
+ * @mmio_cdev The bank containing the entry
+ * @entry     The entry that changed
+ * @old       Its previous value
+ * @value     Its new value
+ */
+void mmio_event_post(struct mmio_classdev *mmio_cdev, struct mmio_entry *entry,
+					 u64 old, u64 value)
+{
+	struct mmio_watcher *w = mmio_cdev->watcher;
+	struct mmio_event_sub *sub;
+	struct mmio_event ev = {
+		.old_value = old,
+		.value     = value,
+		.index     = entry - mmio_cdev->entries,
+	};
+	unsigned long irqflags;
+
+	if (!w || list_empty(&w->event_subs))
+		return;
+
+	ev.time_ns = ktime_get_ns();
+	spin_lock_irqsave(&w->event_lock, irqflags);
+	list_for_each_entry(sub, &w->event_subs, bank_node)
+	{
+		if (test_bit(ev.index, sub->entries))
+		{
+			ev.cookie = sub->cookie;
+			mmio_event_push(sub->queue, &ev);
+		}
+	}
+	spin_unlock_irqrestore(&w->event_lock, irqflags);
+}
+
+static bool mmio_event_pop(struct mmio_event_queue *q, struct mmio_event *ev)
+{
+	bool ret = false;
+
+	spin_lock_irq(&q->lock);
+	if (q->count)
+	{
+		*ev = q->events[q->head];
+		q->head = (q->head + 1) % q->size;
+		q->count--;
+		ret = true;
+	}
+	spin_unlock_irq(&q->lock);
+
+	return ret;
+}
+
+static ssize_t mmio_event_read(struct file *filp, char __user *buf,
+							   size_t count, loff_t *ppos)
+{
+	struct mmio_event_queue *q = filp->private_data;
+	struct mmio_event ev;
+	ssize_t done = 0;
+	int ret;
+
+	if (count < sizeof(ev))
+		return -EINVAL;
+
+	while (!READ_ONCE(q->count))
+	{
+		if (READ_ONCE(q->dead))
+			return 0;
+		if (filp->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+		ret = wait_event_interruptible(q->wait, READ_ONCE(q->count) || READ_ONCE(q->dead));
+		if (ret)
+			return ret;
+	}
+
+	while (count - done >= sizeof(ev) && mmio_event_pop(q, &ev))
+	{
+		// The event is lost, but so is the reader's buffer
+		if (copy_to_user(buf + done, &ev, sizeof(ev)))
+			return done ? done : -EFAULT;
+		done += sizeof(ev);
+	}
+
+	return done;
+}
+
+static __poll_t mmio_event_poll(struct file *filp, poll_table *wait)
+{
+	struct mmio_event_queue *q = filp->private_data;
+
+	poll_wait(filp, &q->wait, wait);
+	if (READ_ONCE(q->count))
+		return EPOLLIN | EPOLLRDNORM;
+	return READ_ONCE(q->dead) ? EPOLLHUP : 0;
+}
+
+/*
+ * Unlink a subscription from its bank and its queue; it is unused once this
+ * returns. The caller holds the handle's lock.
+ */
+static void __mmio_event_unlink(struct mmio_event_sub *sub)
+{
+	struct mmio_watcher *w;
+	struct mmio_event_queue *q = sub->queue;
+	unsigned long irqflags;
+
+	if (!sub->detached)
+	{
+		w = sub->mmio_cdev->watcher;
+		spin_lock_irqsave(&w->event_lock, irqflags);
+		list_del(&sub->bank_node);
+		spin_unlock_irqrestore(&w->event_lock, irqflags);
+		static_branch_dec(&mmio_notify_key);
+
+		spin_lock_irq(&q->lock);
+		q->linked--;
+		spin_unlock_irq(&q->lock);
+	}
+
+	list_del(&sub->queue_node);
+}
+
+static void mmio_event_unlink(struct mmio_event_sub *sub)
+{
+	down_read(&sub->handle->lock);
+	__mmio_event_unlink(sub);
+	up_read(&sub->handle->lock);
+}
+
+static void mmio_event_sub_free(struct mmio_event_sub *sub)
+{
+	mmio_handle_put(sub->handle);
+	kfree(sub);
+}
+
+static void mmio_event_queue_free(struct mmio_event_queue *q)
+{
+	struct mmio_event_sub *sub, *tmp;
+
+	list_for_each_entry_safe(sub, tmp, &q->subs, queue_node)
+	{
+		mmio_event_unlink(sub);
+		mmio_event_sub_free(sub);
+	}
+
+	kvfree(q->events);
+	kfree(q);
+}
+
+static int mmio_event_release(struct inode *inode, struct file *filp)
+{
+	mmio_event_queue_free(filp->private_data);
+	return 0;
+}
+
+/**
+ * mmio_event_detach - Unlink every subscription of a bank being unregistered
+ * @mmio_cdev The bank, its handle locked for write
+ *
+ * Nothing is posted for the bank's subscriptions once this returns. Their
+ * queues keep them until released, and wake their readers if the bank was
+ * the last one they followed.
+ */
+void mmio_event_detach(struct mmio_classdev *mmio_cdev)
+{
+	struct mmio_watcher *w = mmio_cdev->watcher;
+	struct mmio_event_sub *sub, *tmp;
+	struct mmio_event_queue *q;
+	unsigned long irqflags;
+	unsigned int n = 0;
+	bool dead;
+
+	spin_lock_irqsave(&w->event_lock, irqflags);
+	list_for_each_entry_safe(sub, tmp, &w->event_subs, bank_node)
+	{
+		list_del(&sub->bank_node);
+		sub->detached = true;
+		n++;
+
+		q = sub->queue;
+		spin_lock(&q->lock);
+		dead = --q->linked == 0;
+		if (dead)
+			q->dead = true;
+		spin_unlock(&q->lock);
+		if (dead)
+			wake_up_interruptible_poll(&q->wait, EPOLLHUP);
+	}
+	spin_unlock_irqrestore(&w->event_lock, irqflags);
+
+	while (n--)
+		static_branch_dec(&mmio_notify_key);
+}
+
+static const struct file_operations mmio_event_fops = {
+	.owner   = THIS_MODULE,
+	.read    = mmio_event_read,
+	.poll    = mmio_event_poll,
+	.release = mmio_event_release,
+	.llseek  = noop_llseek,
+};
+
+static struct mmio_event_queue *mmio_event_queue_create(u32 size)
+{
+	struct mmio_event_queue *q;
+
+	if (size == 0)
+		size = MMIO_EVENT_DEFAULT_QUEUE;
+	if (size > MMIO_EVENT_MAX_QUEUE)
+		return ERR_PTR(-EINVAL);
+
+	q = kzalloc(sizeof(*q), GFP_KERNEL);
+	if (!q)
+		return ERR_PTR(-ENOMEM);
+
+	q->events = kvcalloc(size, sizeof(*q->events), GFP_KERNEL);
+	if (!q->events)
+	{
+		kfree(q);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	q->size = size;
+	spin_lock_init(&q->lock);
+	init_waitqueue_head(&q->wait);
+	mutex_init(&q->sub_lock);
+	INIT_LIST_HEAD(&q->subs);
+	return q;
+}
+
+static struct mmio_event_sub *mmio_event_sub_create(struct mmio_classdev *mmio_cdev,
+													struct mmio_subscription *cfg)
+{
+	struct mmio_event_sub *sub;
+	struct mmio_entry *entry;
+	u32 *indices;
+	unsigned int i;
+	int ret = 0;
+
+	if (cfg->count > mmio_cdev->num_entries)
+		return ERR_PTR(-EINVAL);
+
+	indices = memdup_user(u64_to_user_ptr(cfg->indices), cfg->count * sizeof(u32));
+	if (IS_ERR(indices))
+		return ERR_CAST(indices);
+
+	sub = kzalloc(struct_size(sub, entries, BITS_TO_LONGS(mmio_cdev->num_entries)), GFP_KERNEL);
+	if (!sub)
+	{
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < cfg->count; i++)
+	{
+		ret = -EINVAL;
+		if (indices[i] >= mmio_cdev->num_entries)
+			break;
+
+		entry = &(mmio_cdev->entries[indices[i]]);
+		ret = -ENOENT;
+		if (!entry->mask)
+			break;
+		ret = -EPERM;
+		if (! (entry->flags & MMIO_ENTRY_READ) )
+			break;
+
+		ret = 0;
+		set_bit(indices[i], sub->entries);
+	}
+
+	sub->mmio_cdev = mmio_cdev;
+	sub->cookie = cfg->cookie;
+
+	out:
+	kfree(indices);
+	if (ret)
+	{
+		kfree(sub);
+		return ERR_PTR(ret);
+	}
+	return sub;
+}
+
+/**
+ * mmio_event_subscribe - MMIO_IOC_SUBSCRIBE: subscribe an event fd to a bank
+ * @mmio_cdev The bank
+ * @filp      The bank's open character device, its handle is held while subscribed
+ * @argp      Userspace struct mmio_subscription
+ *
+ * Returns the event fd, new or not.
+ */
+long mmio_event_subscribe(struct mmio_classdev *mmio_cdev, struct file *filp, void __user *argp)
+{
+	struct mmio_subscription cfg;
+	struct mmio_event_queue *q;
+	struct mmio_event_sub *sub = NULL, *old = NULL, *it;
+	struct mmio_watcher *w = mmio_cdev->watcher;
+	struct mmio_handle *h = filp->private_data;
+	struct file *event_file = NULL;
+	unsigned long irqflags;
+	long ret;
+
+	if (copy_from_user(&cfg, argp, sizeof(cfg)))
+		return -EFAULT;
+
+	if (cfg.count)
+	{
+		sub = mmio_event_sub_create(mmio_cdev, &cfg);
+		if (IS_ERR(sub))
+			return PTR_ERR(sub);
+	}
+
+	if (cfg.fd < 0)
+	{
+		q = mmio_event_queue_create(cfg.queue_size);
+		if (IS_ERR(q))
+		{
+			kfree(sub);
+			return PTR_ERR(q);
+		}
+	}
+	else
+	{
+		event_file = fget(cfg.fd);
+		if (!event_file || event_file->f_op != &mmio_event_fops)
+		{
+			if (event_file)
+				fput(event_file);
+			kfree(sub);
+			return -EBADF;
+		}
+		q = event_file->private_data;
+	}
+
+	mutex_lock(&q->sub_lock);
+	list_for_each_entry(it, &q->subs, queue_node)
+	{
+		if (it->handle == h)
+		{
+			old = it;
+			break;
+		}
+	}
+	if (old)
+		__mmio_event_unlink(old);
+
+	if (sub)
+	{
+		sub->queue = q;
+		sub->handle = mmio_handle_get(h);
+		list_add_tail(&sub->queue_node, &q->subs);
+
+		spin_lock_irq(&q->lock);
+		q->linked++;
+		q->dead = false;
+		spin_unlock_irq(&q->lock);
+
+		spin_lock_irqsave(&w->event_lock, irqflags);
+		list_add_tail(&sub->bank_node, &w->event_subs);
+		spin_unlock_irqrestore(&w->event_lock, irqflags);
+		static_branch_inc(&mmio_notify_key);
+	}
+	mutex_unlock(&q->sub_lock);
+
+	if (old)
+		mmio_event_sub_free(old);
+
+	if (event_file)
+	{
+		fput(event_file);
+		return cfg.fd;
+	}
+
+	ret = anon_inode_getfd("mmio-events", &mmio_event_fops, q, O_RDONLY | O_CLOEXEC);
+	if (ret < 0)
+	{
+		// The new queue only follows this bank, whose handle is already locked
+		if (sub)
+		{
+			__mmio_event_unlink(sub);
+			mmio_event_sub_free(sub);
+		}
+		kvfree(q->events);
+		kfree(q);
+	}
+	return ret;
+}
@@ -0,0 +1,121 @@
+#ifndef __MMIO_INTERNAL_H_INCLUDED
+#define __MMIO_INTERNAL_H_INCLUDED
+
+#include <linux/jump_label.h>
+#include <linux/percpu.h>
+#include "mmio.h"
+#include "mmio_ioctl.h"
+
+struct file;
+
+extern struct class *mmio_class;
+
+// Latency histogram bucket b counts accesses of [2^(b-1), 2^b) ns, the last one up to forever
+#define MMIO_HIST_BUCKETS 32
+
+/*
+ * Per-CPU access counters of a bank, only kept while mmio_stats_key is on.
+ * reads and writes count field accesses, bus_reads and bus_writes the
+ * register accesses that reached the bus (or the bank's ops).
+ */
+struct mmio_stats {
+	u64 reads;
+	u64 writes;
+	u64 overflows;        // Values rejected with -EOVERFLOW
+	u64 bus_reads;
+	u64 bus_writes;
+	u64 bus_ns;           // Time spent in bus accesses
+	u64 contentions;      // Register lock acquisitions that had to wait
+	u64 lock_wait_ns;     // Time spent waiting for them
+	u64 read_hist[MMIO_HIST_BUCKETS];   // Bus read latencies
+	u64 write_hist[MMIO_HIST_BUCKETS];  // Bus write latencies
+};
+
+static inline unsigned int mmio_hist_bucket(u64 ns)
+{
+	return min_t(unsigned int, fls64(ns), MMIO_HIST_BUCKETS - 1);
+}
+
+DECLARE_STATIC_KEY_FALSE(mmio_stats_key);
+// On while anything listens for changes, see mmio_watch.c
+DECLARE_STATIC_KEY_FALSE(mmio_notify_key);
+
+#define mmio_stats_inc(mmio_cdev, field, n)             \
+	do {                                                \
+		if ((mmio_cdev)->stats)                         \
+			this_cpu_add((mmio_cdev)->stats->field, n); \
+	} while (0)
+
+// mmio_core.c
+extern bool mmio_read_never_sleeps(struct mmio_classdev *parent, struct mmio_entry *entry);
+extern u64  mmio_get_value_raw(struct mmio_classdev *parent, struct mmio_entry *entry, u64 *raw);
+extern u64  mmio_get_value_bus(struct mmio_classdev *parent, struct mmio_entry *entry);
+
+/*
+ * Encoder of an MMIO_SAMPLE_COMPRESSED stream, see mmio_ioctl.h. It writes
+ * bytes at head into a power of two sized ring and never past tail. time and
+ * values are what a decoder has seen so far.
+ */
+struct mmio_encoder {
+	u8            *data;
+	u32           mask;
+	u64           head;
+	unsigned int  count;
+	u64           time;
+	u64           values[MMIO_SAMPLE_MAX_ENTRIES];
+	u32           run;             // Unchanged ticks not written yet
+	u64           run_time;        // Time of the last of them
+	u32           skipped;         // Dropped ticks not written yet
+};
+
+// Worst case bytes of a tick together with the run and skip before it
+#define MMIO_ENCODE_MAX_BYTES(count) (50 + 10 * (count))
+
+// mmio_encode.c
+extern bool mmio_encode_tick(struct mmio_encoder *enc, u64 tail, u64 time, const u64 *values);
+extern void mmio_encode_flush(struct mmio_encoder *enc, u64 tail);
+
+// mmio_watch.c
+extern int     mmio_watch_add(struct mmio_classdev *mmio_cdev);
+extern void    mmio_watch_del(struct mmio_classdev *mmio_cdev);
+extern void    mmio_notify_write(struct mmio_classdev *mmio_cdev, struct mmio_entry *entry,
+								 u64 old, u64 value);
+extern ssize_t mmio_watch_show(struct device *dev, struct device_attribute *attr, char *buf);
+extern ssize_t mmio_watch_store(struct device *dev, struct device_attribute *attr,
+								const char *buf, size_t size);
+
+// mmio_cond.c
+extern ssize_t mmio_cond_show(struct device *dev, struct device_attribute *attr, char *buf);
+extern ssize_t mmio_cond_store(struct device *dev, struct device_attribute *attr,
+							   const char *buf, size_t size);
+
+// mmio_wait.c
+extern ssize_t mmio_wait_store(struct device *dev, struct device_attribute *attr,
+							   const char *buf, size_t size);
+
+// mmio_event.c
+extern void mmio_event_post(struct mmio_classdev *mmio_cdev, struct mmio_entry *entry,
+							u64 old, u64 value);
+extern long mmio_event_subscribe(struct mmio_classdev *mmio_cdev, struct file *filp,
+								 void __user *argp);
+
+// mmio_cdev.c
+extern int  mmio_cdev_init(void);
+extern void mmio_cdev_exit(void);
+extern int  mmio_cdev_add(struct mmio_classdev *mmio_cdev, dev_t *devt);
+extern void mmio_cdev_attach(struct mmio_classdev *mmio_cdev);
+extern void mmio_cdev_del(struct mmio_classdev *mmio_cdev);
+
+// mmio_sampler.c
+extern long mmio_sampler_start(struct mmio_classdev *mmio_cdev, struct file *filp,
+							   void __user *argp);
+extern long mmio_capture_start(struct mmio_classdev *mmio_cdev, struct file *filp,
+							   void __user *argp);
+
+// mmio_debugfs.c
+extern void mmio_debugfs_init(void);
+extern void mmio_debugfs_exit(void);
+extern int  mmio_debugfs_add(struct mmio_classdev *mmio_cdev);
+extern void mmio_debugfs_del(struct mmio_classdev *mmio_cdev);
+
+#endif
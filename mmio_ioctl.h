@@ -0,0 +1,229 @@
+#ifndef __UAPI_LINUX_MMIO_IOCTL_H_INCLUDED
+#define __UAPI_LINUX_MMIO_IOCTL_H_INCLUDED
+
+/*
+ * Userspace interface to the /dev/mmio/<bank> character devices.
+ *
+ * Entries are addressed by their index in the bank's entries array, which
+ * can be looked up by name with MMIO_IOC_ENTRY_INFO.
+ *
+ * read() returns one struct mmio_record per entry, starting at the entry
+ * whose index is file position / sizeof(struct mmio_record), so pread() at
+ * index * sizeof(struct mmio_record) fetches a single entry. The records of
+ * one read() are decoded from a single read of each register they cover.
+ *
+ * write() takes an array of struct mmio_record and sets each entry named by
+ * its index to its value. The file position is ignored.
+ *
+ * MMIO_IOC_BATCH runs a vector of struct mmio_op in a single syscall.
+ *
+ * MMIO_IOC_SAMPLE starts sampling a set of entries from an hrtimer and
+ * returns a new file descriptor for the session; closing it stops sampling.
+ * Each tick stores one struct mmio_sample per entry into a ring that the
+ * session fd can read() (blocking unless O_NONBLOCK, and poll()able) or
+ * mmap(). The mapping starts with a struct mmio_sample_ring page followed by
+ * the records; a reader consumes records [tail, head), each at
+ * data_offset + (n % size) * sizeof(struct mmio_sample), and then stores the
+ * new tail. Don't mix read() and a mapping. When the ring is full new
+ * records are dropped and counted.
+ *
+ * With MMIO_SAMPLE_COMPRESSED the ring is a byte stream instead, and
+ * ring_size, head, tail and size count bytes. The stream is a
+ * sequence of items, each starting with a varint (LEB128) (x << 2 | type):
+ *
+ *   MMIO_ITEM_TICK  x is the ns since the previous tick, followed by a varint
+ *                   mask of the entries (by position in indices) that changed
+ *                   and a varint value ^ previous value for each of them
+ *   MMIO_ITEM_RUN   x ticks with no change, followed by a varint of the ns
+ *                   from the previous tick to the last of them; the ones in
+ *                   between are evenly spaced
+ *   MMIO_ITEM_SKIP  x ticks were dropped for lack of room
+ *
+ * Times and values start out as 0, and a decoder numbers ticks from 0 like
+ * seq. A pending run is written when a value changes, once it is
+ * MMIO_SAMPLE_MAX_RUN ticks long, or when a reader is waiting in read() or
+ * poll(). See tools/mmio_decode.h for a decoder.
+ *
+ * MMIO_IOC_CAPTURE starts the same kind of session armed with a trigger on
+ * one of the sampled entries. Until it fires the ring is overwritten in a
+ * circle and nothing can be read; post ticks after the trigger the timer
+ * stops and the ring header publishes the last pre ticks before the trigger,
+ * the triggering tick and the post ticks after it as [tail, head), with
+ * trigger_seq set to the triggering tick's seq. The ring must hold
+ * (pre + 1 + post) * count records. state follows the MMIO_CAPTURE_* values.
+ * Captures can't be MMIO_SAMPLE_COMPRESSED.
+ *
+ * MMIO_IOC_SUBSCRIBE subscribes an event fd to changes of a set of the
+ * bank's entries, creating the fd if the fd field is -1. Passing an event fd
+ * from an earlier call instead adds this bank to it, or replaces this bank's
+ * set of entries; a count of 0 removes the bank. One fd can so follow
+ * entries of any number of banks, told apart by the cookie given for each.
+ * The ioctl returns the event fd. read() on it returns struct mmio_event
+ * records, blocking unless O_NONBLOCK, and it can be poll()ed. Each fd has
+ * its own queue; events that don't fit are dropped and counted in the next
+ * event queued. Changes are only seen where something watches for them,
+ * see the README.
+ *
+ * MMIO_IOC_WAIT polls an entry in the kernel until (field & mask) equals
+ * (value & mask), with a backoff from 1 us to 1 ms between reads, and fails
+ * with ETIMEDOUT if that takes longer than timeout_us, at most
+ * MMIO_WAIT_MAX_TIMEOUT_US. Reads always go to the bus, even on cached banks,
+ * so waits on MMIO_BANK_WRITE_ONLY banks fail with EOPNOTSUPP.
+ *
+ * mmap() at offset 0 maps the pages covering the bank's registers uncached,
+ * at most PAGE_ALIGN(map_offset + span) bytes. The bank's first register is
+ * at map_offset from MMIO_IOC_BANK_INFO within the mapping. Banks with no
+ * writable entries can only be mapped read-only.
+ */
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+#define MMIO_NAME_MAX        32
+#define MMIO_BATCH_MAX       256
+
+#define MMIO_SAMPLE_MAX_ENTRIES    64
+#define MMIO_SAMPLE_MIN_PERIOD_NS  1000
+#define MMIO_SAMPLE_DEFAULT_RING   4096
+#define MMIO_SAMPLE_MAX_RING       (1 << 20)
+#define MMIO_SAMPLE_MAX_RUN        65536
+
+#define MMIO_SAMPLE_COMPRESSED     (1 << 0)  // mmio_sample_config flags
+
+#define MMIO_ITEM_TICK       0
+#define MMIO_ITEM_RUN        1
+#define MMIO_ITEM_SKIP       2
+
+#define MMIO_EVENT_DEFAULT_QUEUE   256
+#define MMIO_EVENT_MAX_QUEUE       65536
+
+#define MMIO_WAIT_MAX_TIMEOUT_US   10000000
+
+#define MMIO_OP_READ         0
+#define MMIO_OP_WRITE        1
+
+#define MMIO_TRIG_EQ         0    // Field equals value
+#define MMIO_TRIG_CHANGE     1    // Field differs from the previous tick
+#define MMIO_TRIG_RISE       2    // Field is greater than on the previous tick
+#define MMIO_TRIG_FALL       3    // Field is less than on the previous tick
+#define MMIO_TRIG_MASK       4    // (register & mask) == value on the whole register
+
+#define MMIO_CAPTURE_ARMED      0
+#define MMIO_CAPTURE_TRIGGERED  1 // Capturing the post ticks
+#define MMIO_CAPTURE_DONE       2 // Frozen, [tail, head) is the capture
+
+struct mmio_record {
+	__u32 index;                  // Entry index within the bank
+	__s32 result;                 // 0 or negative errno (read only)
+	__u64 value;                  // Field value
+};
+
+struct mmio_op {
+	__u32 index;                  // Entry index within the bank
+	__u32 op;                     // MMIO_OP_READ or MMIO_OP_WRITE
+	__u64 value;                  // Value to write, or the value read
+	__s32 result;                 // 0 or negative errno, filled in by the kernel
+	__u32 reserved;
+};
+
+struct mmio_batch {
+	__u64 ops;                    // Userspace pointer to struct mmio_op[count]
+	__u32 count;                  // At most MMIO_BATCH_MAX
+	__u32 reserved;
+};
+
+struct mmio_bank_info {
+	char  name[MMIO_NAME_MAX];
+	__u32 size;                   // Default register size in bytes
+	__u32 offset;                 // Offset of the registers from the bank base
+	__u32 num_entries;
+	__u32 map_offset;             // Offset of the registers in the mmap()ed pages
+	__u32 span;                   // Bytes covered by the registers
+	__u32 num_regs;
+};
+
+struct mmio_entry_info {
+	__u32 index;                  // Set by the caller
+	__u32 flags;                  // MMIO_ENTRY_* flags
+	__u64 mask;
+	char  name[MMIO_NAME_MAX];
+	__u32 offset;                 // Offset of the entry's register from the bank's
+	__u32 size;                   // Size of the entry's register in bytes
+};
+
+struct mmio_sample_config {
+	__u64 indices;                // Userspace pointer to __u32[count] entry indexes
+	__u32 count;                  // At most MMIO_SAMPLE_MAX_ENTRIES
+	__u32 period_ns;              // At least MMIO_SAMPLE_MIN_PERIOD_NS
+	__u32 ring_size;              // Records, or bytes if compressed; a power of two, 0 for the default
+	__u32 flags;                  // MMIO_SAMPLE_*
+};
+
+struct mmio_sample {
+	__u64 time_ns;                // CLOCK_MONOTONIC time of the tick
+	__u64 value;                  // Field value
+	__u32 index;                  // Entry index within the bank
+	__u32 seq;                    // Tick number, the same for all records of a tick
+};
+
+struct mmio_sample_ring {
+	__u64 head;                   // Records produced, written by the kernel
+	__u64 tail;                   // Records consumed, written by the reader
+	__u64 dropped;                // Records lost to a full ring
+	__u32 size;                   // Records in the ring
+	__u32 data_offset;            // Offset of the records in the mapping
+	__u32 state;                  // MMIO_CAPTURE_* for capture sessions
+	__u32 trigger_seq;            // seq of the tick that fired the trigger
+};
+
+struct mmio_trigger {
+	__u32 index;                  // Entry index within the bank, one of the sampled
+	__u32 type;                   // MMIO_TRIG_*
+	__u64 value;
+	__u64 mask;                   // Register mask for MMIO_TRIG_MASK, otherwise 0
+};
+
+struct mmio_capture_config {
+	struct mmio_sample_config sample;
+	struct mmio_trigger trigger;
+	__u32 pre;                    // Ticks kept from before the trigger
+	__u32 post;                   // Ticks captured after it
+};
+
+struct mmio_subscription {
+	__u64 indices;                // Userspace pointer to __u32[count] entry indexes
+	__u32 count;                  // 0 unsubscribes the bank
+	__s32 fd;                     // Event fd to add the bank to, or -1 for a new one
+	__u32 queue_size;             // Events, for a new fd; 0 for the default
+	__u32 cookie;                 // Copied into the events of this bank
+};
+
+struct mmio_event {
+	__u64 time_ns;                // CLOCK_MONOTONIC time the change was seen
+	__u64 old_value;
+	__u64 value;
+	__u32 index;                  // Entry index within the bank
+	__u32 cookie;                 // From the bank's mmio_subscription
+	__u32 dropped;                // Events lost to a full queue just before this one
+	__u32 reserved;
+};
+
+struct mmio_wait {
+	__u32 index;                  // Entry index within the bank
+	__u32 reserved;               // Must be 0
+	__u64 value;                  // Field value to wait for
+	__u64 mask;                   // Bits of the field to compare, 0 for all
+	__u64 timeout_us;             // 0 checks once, at most MMIO_WAIT_MAX_TIMEOUT_US
+};
+
+#define MMIO_IOC_MAGIC       'M'
+
+#define MMIO_IOC_BANK_INFO   _IOR(MMIO_IOC_MAGIC, 0, struct mmio_bank_info)
+#define MMIO_IOC_ENTRY_INFO  _IOWR(MMIO_IOC_MAGIC, 1, struct mmio_entry_info)
+#define MMIO_IOC_BATCH       _IOW(MMIO_IOC_MAGIC, 2, struct mmio_batch)
+#define MMIO_IOC_SAMPLE      _IOW(MMIO_IOC_MAGIC, 3, struct mmio_sample_config)
+#define MMIO_IOC_CAPTURE     _IOW(MMIO_IOC_MAGIC, 4, struct mmio_capture_config)
+#define MMIO_IOC_SUBSCRIBE   _IOW(MMIO_IOC_MAGIC, 5, struct mmio_subscription)
+#define MMIO_IOC_WAIT        _IOW(MMIO_IOC_MAGIC, 6, struct mmio_wait)
+
+#endif
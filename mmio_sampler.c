@@ -0,0 +1,572 @@
+/*
+ * MMIO hrtimer sampler
+ *
+ * Copyright (C) 2014 Joe Balough <jbb5044@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * MMIO_IOC_SAMPLE creates a sampling session: an hrtimer reads a set of
+ * entries with mmio_get_value every period and appends timestamped records
+ * to a ring buffer, which userspace drains through the session's own file
+ * descriptor with read() or mmap(). See mmio_ioctl.h for the layout.
+ *
+ * The timer callback is the only producer and the session's reader the only
+ * consumer, so the ring needs no lock: the producer publishes head with a
+ * release store after writing the records, and the consumer publishes tail
+ * the same way after copying them out. tail may be written by userspace
+ * through the mapping, so the kernel only ever uses it masked or clamped.
+ *
+ * MMIO_SAMPLE_COMPRESSED sessions use the same protocol on a byte ring
+ * written by mmio_encode.c.
+ *
+ * MMIO_IOC_CAPTURE sessions have no consumer until they are done: the timer
+ * overwrites the ring in a circle without looking at tail, and publishes
+ * head and tail once, when the capture freezes.
+ *
+ * Sessions are listed in their bank's handle, see mmio_cdev.h, and stopped
+ * by mmio_sampler_detach when the bank is unregistered. What they recorded
+ * can still be read, after which they report end of file.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/anon_inodes.h>
+#include <linux/err.h>
+#include <linux/fs.h>
+#include <linux/file.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/mm.h>
+#include <linux/poll.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+#include <linux/wait.h>
+#include "mmio_cdev.h"
+#include "mmio_ioctl.h"
+
+struct mmio_sampler {
+	struct mmio_classdev     *mmio_cdev;
+	struct mmio_handle       *handle;      // Holds a reference while listed or not
+	struct list_head         node;         // In the handle's sessions until detached
+	bool                     detached;     // Stopped, the bank may be gone
+	struct hrtimer           timer;
+	ktime_t                  period;
+	struct mmio_entry        **entries;
+	u32                      *indices;
+	unsigned int             count;
+	u32                      seq;
+	u64                      head;         // Private copy, ring->head is only published
+	struct mmio_sample_ring  *ring;        // Header page, followed by the records
+	struct mmio_sample       *data;
+	u32                      mask;
+	size_t                   unit;         // Bytes per ring slot
+	wait_queue_head_t        wait;
+
+	// MMIO_SAMPLE_COMPRESSED only
+	struct mmio_encoder      *enc;
+	u64                      *values;
+
+	// Capture sessions only
+	bool                     capture;
+	struct mmio_trigger      trigger;
+	unsigned int             trigger_pos;  // Position of the trigger entry in entries
+	u32                      pre, post, left;
+	u32                      state;        // MMIO_CAPTURE_*, ring->state is a copy
+	bool                     primed;       // prev holds the previous tick's value
+	u64                      prev;
+};
+
+static enum hrtimer_restart mmio_sampler_tick(struct hrtimer *timer)
+{
+	struct mmio_sampler *s = container_of(timer, struct mmio_sampler, timer);
+	struct mmio_sample *rec;
+	u64 tail, now = ktime_get_ns();
+	unsigned int i, dropped = 0;
+
+	// Pairs with the release of tail in mmio_sampler_read, or userspace's
+	tail = smp_load_acquire(&s->ring->tail);
+
+	for (i = 0; i < s->count; i++)
+	{
+		if (s->head - tail > s->mask)
+		{
+			dropped++;
+			continue;
+		}
+
+		rec = &s->data[s->head & s->mask];
+		rec->time_ns = now;
+		rec->value = mmio_get_value(s->mmio_cdev, s->entries[i]);
+		rec->index = s->indices[i];
+		rec->seq = s->seq;
+		s->head++;
+	}
+	s->seq++;
+
+	if (dropped)
+		WRITE_ONCE(s->ring->dropped, s->ring->dropped + dropped);
+	smp_store_release(&s->ring->head, s->head);
+
+	if (wq_has_sleeper(&s->wait))
+		wake_up_interruptible_poll(&s->wait, EPOLLIN | EPOLLRDNORM);
+
+	hrtimer_forward_now(timer, s->period);
+	return HRTIMER_RESTART;
+}
+
+static enum hrtimer_restart mmio_sampler_compressed_tick(struct hrtimer *timer)
+{
+	struct mmio_sampler *s = container_of(timer, struct mmio_sampler, timer);
+	u64 tail, now = ktime_get_ns();
+	unsigned int i;
+
+	tail = smp_load_acquire(&s->ring->tail);
+
+	for (i = 0; i < s->count; i++)
+		s->values[i] = mmio_get_value(s->mmio_cdev, s->entries[i]);
+
+	if (!mmio_encode_tick(s->enc, tail, now, s->values))
+		WRITE_ONCE(s->ring->dropped, s->ring->dropped + s->count);
+
+	// Don't keep a reader waiting for a run to end
+	if (wq_has_sleeper(&s->wait))
+		mmio_encode_flush(s->enc, tail);
+	smp_store_release(&s->ring->head, s->enc->head);
+
+	if (wq_has_sleeper(&s->wait))
+		wake_up_interruptible_poll(&s->wait, EPOLLIN | EPOLLRDNORM);
+
+	hrtimer_forward_now(timer, s->period);
+	return HRTIMER_RESTART;
+}
+
+static bool mmio_trigger_match(struct mmio_sampler *s, u64 value, u64 raw)
+{
+	switch (s->trigger.type)
+	{
+		case MMIO_TRIG_EQ:     return value == s->trigger.value;
+		case MMIO_TRIG_CHANGE: return s->primed && value != s->prev;
+		case MMIO_TRIG_RISE:   return s->primed && value > s->prev;
+		case MMIO_TRIG_FALL:   return s->primed && value < s->prev;
+		case MMIO_TRIG_MASK:   return (raw & s->trigger.mask) == s->trigger.value;
+	}
+	return false;
+}
+
+static enum hrtimer_restart mmio_capture_tick(struct hrtimer *timer)
+{
+	struct mmio_sampler *s = container_of(timer, struct mmio_sampler, timer);
+	struct mmio_sample *rec;
+	u64 value = 0, raw = 0, kept, now = ktime_get_ns();
+	unsigned int i;
+
+	for (i = 0; i < s->count; i++)
+	{
+		rec = &s->data[s->head & s->mask];
+		rec->time_ns = now;
+		if (i == s->trigger_pos)
+			rec->value = value = mmio_get_value_raw(s->mmio_cdev, s->entries[i], &raw);
+		else
+			rec->value = mmio_get_value(s->mmio_cdev, s->entries[i]);
+		rec->index = s->indices[i];
+		rec->seq = s->seq;
+		s->head++;
+	}
+
+	if (s->state == MMIO_CAPTURE_ARMED)
+	{
+		if (mmio_trigger_match(s, value, raw))
+		{
+			s->state = MMIO_CAPTURE_TRIGGERED;
+			s->left = s->post;
+			WRITE_ONCE(s->ring->trigger_seq, s->seq);
+			WRITE_ONCE(s->ring->state, MMIO_CAPTURE_TRIGGERED);
+		}
+		s->prev = value;
+		s->primed = true;
+	}
+	else
+	{
+		s->left--;
+	}
+	s->seq++;
+
+	if (s->state == MMIO_CAPTURE_ARMED || s->left)
+	{
+		hrtimer_forward_now(timer, s->period);
+		return HRTIMER_RESTART;
+	}
+
+	// Fewer than pre ticks before the trigger if it fired early
+	kept = min_t(u64, s->head, (u64) (s->pre + 1 + s->post) * s->count);
+	WRITE_ONCE(s->ring->tail, s->head - kept);
+	smp_store_release(&s->ring->head, s->head);
+	WRITE_ONCE(s->ring->state, MMIO_CAPTURE_DONE);
+	// Pairs with mmio_sampler_eof, after head so a drained capture means EOF
+	smp_store_release(&s->state, MMIO_CAPTURE_DONE);
+
+	wake_up_interruptible_poll(&s->wait, EPOLLIN | EPOLLRDNORM);
+	return HRTIMER_NORESTART;
+}
+
+static u64 mmio_sampler_avail(struct mmio_sampler *s, u64 *tail)
+{
+	u64 head = smp_load_acquire(&s->ring->head);
+
+	*tail = READ_ONCE(s->ring->tail);
+	return min_t(u64, head - *tail, s->mask + 1);
+}
+
+// A capture that is done or a detached session, fully read
+static bool mmio_sampler_eof(struct mmio_sampler *s)
+{
+	u64 tail;
+
+	if (smp_load_acquire(&s->detached))
+		return !mmio_sampler_avail(s, &tail);
+	return s->capture && smp_load_acquire(&s->state) == MMIO_CAPTURE_DONE &&
+		   !mmio_sampler_avail(s, &tail);
+}
+
+static ssize_t mmio_sampler_read(struct file *filp, char __user *buf,
+								 size_t count, loff_t *ppos)
+{
+	struct mmio_sampler *s = filp->private_data;
+	size_t rec = s->unit;
+	u64 tail, n, first;
+	int ret;
+
+	if (count < rec)
+		return -EINVAL;
+
+	while (!mmio_sampler_avail(s, &tail))
+	{
+		if (mmio_sampler_eof(s))
+			return 0;
+		if (filp->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+		ret = wait_event_interruptible(s->wait, mmio_sampler_avail(s, &tail) ||
+									   mmio_sampler_eof(s));
+		if (ret)
+			return ret;
+	}
+
+	n = min_t(u64, mmio_sampler_avail(s, &tail), count / rec);
+
+	// The records may wrap around the end of the ring
+	first = min_t(u64, n, s->mask + 1 - (tail & s->mask));
+	if (copy_to_user(buf, (void *) s->data + (tail & s->mask) * rec, first * rec))
+		return -EFAULT;
+	if (n > first && copy_to_user(buf + first * rec, s->data, (n - first) * rec))
+		return -EFAULT;
+
+	smp_store_release(&s->ring->tail, tail + n);
+	return n * rec;
+}
+
+static __poll_t mmio_sampler_poll(struct file *filp, poll_table *wait)
+{
+	struct mmio_sampler *s = filp->private_data;
+	u64 tail;
+
+	poll_wait(filp, &s->wait, wait);
+	if (mmio_sampler_eof(s))
+		return EPOLLHUP;
+	return mmio_sampler_avail(s, &tail) ? EPOLLIN | EPOLLRDNORM : 0;
+}
+
+static int mmio_sampler_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	struct mmio_sampler *s = filp->private_data;
+
+	if (vma->vm_pgoff != 0)
+		return -EINVAL;
+
+	return remap_vmalloc_range(vma, s->ring, 0);
+}
+
+static void mmio_sampler_free(struct mmio_sampler *s)
+{
+	vfree(s->ring);
+	kfree(s->enc);
+	kfree(s->values);
+	kfree(s->entries);
+	kfree(s->indices);
+	kfree(s);
+}
+
+static int mmio_sampler_release(struct inode *inode, struct file *filp)
+{
+	struct mmio_sampler *s = filp->private_data;
+
+	// Under session_lock, or the bank could go while the timer still reads it
+	mutex_lock(&s->handle->session_lock);
+	hrtimer_cancel(&s->timer);
+	if (!s->detached)
+		list_del(&s->node);
+	mutex_unlock(&s->handle->session_lock);
+
+	mmio_handle_put(s->handle);
+	mmio_sampler_free(s);
+	return 0;
+}
+
+/**
+ * mmio_sampler_detach - Stop every session of a bank being unregistered
+ * @h The bank's handle, locked for write
+ *
+ * Once this returns no session touches the bank again. Readers are woken to
+ * drain what was recorded and then see end of file.
+ */
+void mmio_sampler_detach(struct mmio_handle *h)
+{
+	struct mmio_sampler *s, *tmp;
+
+	mutex_lock(&h->session_lock);
+	list_for_each_entry_safe(s, tmp, &h->sessions, node)
+	{
+		hrtimer_cancel(&s->timer);
+		list_del(&s->node);
+		// Pairs with mmio_sampler_eof
+		smp_store_release(&s->detached, true);
+		wake_up_interruptible_poll(&s->wait, EPOLLIN | EPOLLRDNORM | EPOLLHUP);
+	}
+	mutex_unlock(&h->session_lock);
+}
+
+static const struct file_operations mmio_sampler_fops = {
+	.owner   = THIS_MODULE,
+	.read    = mmio_sampler_read,
+	.poll    = mmio_sampler_poll,
+	.mmap    = mmio_sampler_mmap,
+	.release = mmio_sampler_release,
+	.llseek  = noop_llseek,
+};
+
+/*
+ * Validates cfg and sets up a stopped session. Entries are read from the
+ * timer, so each must be readable without sleeping: on banks without
+ * MMIO_BANK_ATOMIC that rules out cached entries that aren't
+ * MMIO_ENTRY_VOLATILE and MMIO_BANK_READ_SIDE_EFFECTS banks. The ring must
+ * hold at least min_ring records. Compressed rings are sized in bytes, with
+ * the same default and limit on their memory as record rings.
+ */
+static struct mmio_sampler *mmio_sampler_create(struct mmio_classdev *mmio_cdev,
+												struct mmio_sample_config *cfg, u32 min_ring)
+{
+	bool compressed = cfg->flags & MMIO_SAMPLE_COMPRESSED;
+	size_t unit = compressed ? 1 : sizeof(struct mmio_sample);
+	u32 scale = sizeof(struct mmio_sample) / unit;
+	struct mmio_sampler *s;
+	struct mmio_entry *entry;
+	unsigned int i;
+	size_t data_offset;
+	int ret;
+
+	if (cfg->count == 0 || cfg->count > MMIO_SAMPLE_MAX_ENTRIES)
+		return ERR_PTR(-EINVAL);
+	if (cfg->flags & ~MMIO_SAMPLE_COMPRESSED)
+		return ERR_PTR(-EINVAL);
+	if (cfg->period_ns < MMIO_SAMPLE_MIN_PERIOD_NS)
+		return ERR_PTR(-EINVAL);
+	// Room for a pending run and skip and a tick of every entry
+	if (compressed)
+		min_ring = MMIO_ENCODE_MAX_BYTES(cfg->count);
+	if (cfg->ring_size == 0)
+		cfg->ring_size = max_t(u32, roundup_pow_of_two(MMIO_SAMPLE_DEFAULT_RING * scale),
+							   roundup_pow_of_two(min_ring));
+	if (!is_power_of_2(cfg->ring_size) || cfg->ring_size > MMIO_SAMPLE_MAX_RING * scale ||
+		cfg->ring_size < min_ring)
+		return ERR_PTR(-EINVAL);
+
+	s = kzalloc(sizeof(*s), GFP_KERNEL);
+	if (!s)
+		return ERR_PTR(-ENOMEM);
+
+	s->indices = memdup_user(u64_to_user_ptr(cfg->indices), cfg->count * sizeof(u32));
+	if (IS_ERR(s->indices))
+	{
+		ret = PTR_ERR(s->indices);
+		s->indices = NULL;
+		goto failed_free;
+	}
+
+	s->entries = kcalloc(cfg->count, sizeof(*s->entries), GFP_KERNEL);
+	if (!s->entries)
+	{
+		ret = -ENOMEM;
+		goto failed_free;
+	}
+
+	for (i = 0; i < cfg->count; i++)
+	{
+		ret = -EINVAL;
+		if (s->indices[i] >= mmio_cdev->num_entries)
+			goto failed_free;
+
+		entry = &(mmio_cdev->entries[s->indices[i]]);
+		ret = -ENOENT;
+		if (!entry->mask)
+			goto failed_free;
+		ret = -EPERM;
+		if (! (entry->flags & MMIO_ENTRY_READ) )
+			goto failed_free;
+		ret = -EINVAL;
+		if (!mmio_read_never_sleeps(mmio_cdev, entry))
+			goto failed_free;
+
+		s->entries[i] = entry;
+	}
+
+	if (compressed)
+	{
+		s->enc = kzalloc(sizeof(*s->enc), GFP_KERNEL);
+		s->values = kcalloc(cfg->count, sizeof(*s->values), GFP_KERNEL);
+		if (!s->enc || !s->values)
+		{
+			ret = -ENOMEM;
+			goto failed_free;
+		}
+	}
+
+	data_offset = PAGE_SIZE;
+	s->ring = vmalloc_user(data_offset + (size_t) cfg->ring_size * unit);
+	if (!s->ring)
+	{
+		ret = -ENOMEM;
+		goto failed_free;
+	}
+	s->ring->size = cfg->ring_size;
+	s->ring->data_offset = data_offset;
+	s->data = (void *) s->ring + data_offset;
+	s->mask = cfg->ring_size - 1;
+	s->unit = unit;
+
+	s->mmio_cdev = mmio_cdev;
+	s->count = cfg->count;
+	s->period = ns_to_ktime(cfg->period_ns);
+	init_waitqueue_head(&s->wait);
+	hrtimer_init(&s->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	s->timer.function = mmio_sampler_tick;
+
+	if (compressed)
+	{
+		s->enc->data = (u8 *) s->data;
+		s->enc->mask = s->mask;
+		s->enc->count = s->count;
+		s->timer.function = mmio_sampler_compressed_tick;
+	}
+
+	return s;
+
+	failed_free:
+	mmio_sampler_free(s);
+	return ERR_PTR(ret);
+}
+
+// Starts the timer and returns the session's fd, or frees the session
+static long mmio_sampler_run(struct mmio_sampler *s, struct file *filp)
+{
+	struct mmio_handle *h = filp->private_data;
+	int fd;
+
+	// Start first, the session may be closed as soon as its fd exists
+	s->handle = mmio_handle_get(h);
+	mutex_lock(&h->session_lock);
+	list_add_tail(&s->node, &h->sessions);
+	mutex_unlock(&h->session_lock);
+	hrtimer_start(&s->timer, s->period, HRTIMER_MODE_REL);
+
+	// Writable so a mapping can store tail
+	fd = anon_inode_getfd("mmio-sampler", &mmio_sampler_fops, s, O_RDWR | O_CLOEXEC);
+	if (fd < 0)
+	{
+		mutex_lock(&h->session_lock);
+		list_del(&s->node);
+		mutex_unlock(&h->session_lock);
+		hrtimer_cancel(&s->timer);
+		mmio_handle_put(h);
+		mmio_sampler_free(s);
+	}
+
+	return fd;
+}
+
+/**
+ * mmio_sampler_start - MMIO_IOC_SAMPLE: start a session and return its fd
+ * @mmio_cdev The bank to sample
+ * @filp      The bank's open character device, its handle is held until the session ends
+ * @argp      Userspace struct mmio_sample_config
+ */
+long mmio_sampler_start(struct mmio_classdev *mmio_cdev, struct file *filp, void __user *argp)
+{
+	struct mmio_sample_config cfg;
+	struct mmio_sampler *s;
+
+	if (copy_from_user(&cfg, argp, sizeof(cfg)))
+		return -EFAULT;
+
+	s = mmio_sampler_create(mmio_cdev, &cfg, cfg.count);
+	if (IS_ERR(s))
+		return PTR_ERR(s);
+
+	return mmio_sampler_run(s, filp);
+}
+
+/**
+ * mmio_capture_start - MMIO_IOC_CAPTURE: arm a triggered capture, return its fd
+ * @mmio_cdev The bank to sample
+ * @filp      The bank's open character device, its handle is held until the session ends
+ * @argp      Userspace struct mmio_capture_config
+ *
+ * The trigger is evaluated once per tick on the value read for the sampled
+ * entry it names, so it sees exactly what ends up in the capture.
+ */
+long mmio_capture_start(struct mmio_classdev *mmio_cdev, struct file *filp, void __user *argp)
+{
+	struct mmio_capture_config cfg;
+	struct mmio_sampler *s;
+	unsigned int i;
+	u64 min_ring;
+
+	if (copy_from_user(&cfg, argp, sizeof(cfg)))
+		return -EFAULT;
+	if (cfg.trigger.type > MMIO_TRIG_MASK)
+		return -EINVAL;
+	if (cfg.trigger.type != MMIO_TRIG_MASK && cfg.trigger.mask)
+		return -EINVAL;
+	// The frozen window is counted in records
+	if (cfg.sample.flags & MMIO_SAMPLE_COMPRESSED)
+		return -EINVAL;
+
+	min_ring = ((u64) cfg.pre + 1 + cfg.post) * cfg.sample.count;
+	if (min_ring > MMIO_SAMPLE_MAX_RING)
+		return -EINVAL;
+
+	s = mmio_sampler_create(mmio_cdev, &cfg.sample, min_ring);
+	if (IS_ERR(s))
+		return PTR_ERR(s);
+
+	for (i = 0; i < s->count; i++)
+		if (s->indices[i] == cfg.trigger.index)
+			break;
+	if (i == s->count)
+	{
+		mmio_sampler_free(s);
+		return -EINVAL;
+	}
+
+	s->capture = true;
+	s->trigger = cfg.trigger;
+	s->trigger_pos = i;
+	s->pre = cfg.pre;
+	s->post = cfg.post;
+	s->state = MMIO_CAPTURE_ARMED;
+	s->timer.function = mmio_capture_tick;
+
+	return mmio_sampler_run(s, filp);
+}
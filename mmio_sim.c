@@ -0,0 +1,289 @@
+/*
+ * MMIO simulated banks
+ *
+ * Copyright (C) 2014 Joe Balough <jbb5044@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Registers a set of sample banks backed by ordinary memory instead of
+ * ioremapped hardware, so the mmio class can be exercised and benchmarked
+ * on any machine. Each bank has a "sim" directory with read_latency_ns and
+ * write_latency_ns knobs that busy-wait on every bus access to mimic slow
+ * targets such as GPMC-attached microcontrollers or PCIe devices.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/device.h>
+#include <linux/delay.h>
+#include <linux/gfp.h>
+#include <linux/sysfs.h>
+#include "mmio.h"
+
+// Longest latency a knob accepts; accesses busy-wait, possibly with IRQs off
+#define MMIO_SIM_MAX_LATENCY_NS (10 * NSEC_PER_MSEC)
+
+static unsigned int read_latency_ns;
+module_param(read_latency_ns, uint, 0444);
+MODULE_PARM_DESC(read_latency_ns, "Initial read latency of the simulated banks in ns");
+
+static unsigned int write_latency_ns;
+module_param(write_latency_ns, uint, 0444);
+MODULE_PARM_DESC(write_latency_ns, "Initial write latency of the simulated banks in ns");
+
+struct mmio_sim_bank {
+	struct mmio_classdev  mmio_cdev;
+	unsigned int          read_latency_ns;
+	unsigned int          write_latency_ns;
+};
+
+static struct mmio_entry mmio_sim8_entries[] = {
+	{.name = "enable", .mask = BIT(0), .flags = MMIO_ENTRY_RW },
+	{.name = "mode",   .mask = 0x0e,   .flags = MMIO_ENTRY_RW },
+	{.name = "ready",  .mask = BIT(7), .flags = MMIO_ENTRY_RW },
+};
+
+static struct mmio_entry mmio_sim16_entries[] = {
+	{.name = "low",  .mask = 0x00ff, .flags = MMIO_ENTRY_RW },
+	{.name = "high", .mask = 0xff00, .flags = MMIO_ENTRY_RW },
+};
+
+static struct mmio_entry mmio_sim32_entries[] = {
+	{.name = "control", .mask = 0x0000ffff, .flags = MMIO_ENTRY_RW },
+	{.name = "status",  .mask = 0xffff0000, .flags = MMIO_ENTRY_RW },
+};
+
+static struct mmio_entry mmio_sim64_entries[] = {
+	{.name = "counter", .mask = ~0ULL, .flags = MMIO_ENTRY_RW },
+};
+
+static struct mmio_entry mmio_sim_block_entries[] = {
+	{.name = "ctrl_enable", .mask = BIT(0), .flags = MMIO_ENTRY_RW, .offset = 0x00 },
+	{.name = "ctrl_mode",   .mask = 0x06,   .flags = MMIO_ENTRY_RW, .offset = 0x00 },
+	{.name = "status",      .mask = 0xffff, .flags = MMIO_ENTRY_RW, .offset = 0x04 },
+	{.name = "fifo_level",  .mask = 0xff,   .flags = MMIO_ENTRY_RW, .offset = 0x08, .size = 1 },
+	{.name = "timestamp",   .mask = ~0ULL,  .flags = MMIO_ENTRY_RW, .offset = 0x10, .size = 8 },
+};
+
+#define MMIO_SIM_BANK(_name, _size, _entries)              \
+	{ .mmio_cdev = {                                       \
+		.name        = _name,                              \
+		.size        = _size,                              \
+		.entries     = _entries,                           \
+		.num_entries = ARRAY_SIZE(_entries),               \
+	} }
+
+static struct mmio_sim_bank mmio_sim_banks[] = {
+	MMIO_SIM_BANK("sim8",      1, mmio_sim8_entries),
+	MMIO_SIM_BANK("sim16",     2, mmio_sim16_entries),
+	MMIO_SIM_BANK("sim32",     4, mmio_sim32_entries),
+	MMIO_SIM_BANK("sim64",     8, mmio_sim64_entries),
+	MMIO_SIM_BANK("sim_block", 4, mmio_sim_block_entries),
+};
+
+static inline struct mmio_sim_bank *to_sim_bank(struct mmio_classdev *mmio_cdev)
+{
+	return container_of(mmio_cdev, struct mmio_sim_bank, mmio_cdev);
+}
+
+static void mmio_sim_delay(unsigned int ns)
+{
+	if (ns >= 1000)
+		udelay(ns / 1000);
+	ndelay(ns % 1000);
+}
+
+static u64 mmio_sim_read(struct mmio_classdev *mmio_cdev, struct mmio_reg *reg)
+{
+	void *addr = (void __force *) reg->addr;
+
+	mmio_sim_delay(READ_ONCE(to_sim_bank(mmio_cdev)->read_latency_ns));
+
+	switch (reg->size)
+	{
+		case 1:
+			return READ_ONCE(*(u8 *) addr);
+		case 2:
+			return READ_ONCE(*(u16 *) addr);
+		case 4:
+			return READ_ONCE(*(u32 *) addr);
+		default:
+			return READ_ONCE(*(u64 *) addr);
+	}
+}
+
+static void mmio_sim_write(struct mmio_classdev *mmio_cdev, struct mmio_reg *reg, u64 val)
+{
+	void *addr = (void __force *) reg->addr;
+
+	mmio_sim_delay(READ_ONCE(to_sim_bank(mmio_cdev)->write_latency_ns));
+
+	switch (reg->size)
+	{
+		case 1:
+			WRITE_ONCE(*(u8 *) addr, val);
+			break;
+		case 2:
+			WRITE_ONCE(*(u16 *) addr, val);
+			break;
+		case 4:
+			WRITE_ONCE(*(u32 *) addr, val);
+			break;
+		default:
+			WRITE_ONCE(*(u64 *) addr, val);
+			break;
+	}
+}
+
+static const struct mmio_bus_ops mmio_sim_ops = {
+	.read  = mmio_sim_read,
+	.write = mmio_sim_write,
+};
+
+static int mmio_sim_parse_latency(const char *buf, unsigned int *ns)
+{
+	int ret;
+
+	ret = kstrtouint(buf, 10, ns);
+	if (ret)
+		return ret;
+	if (*ns > MMIO_SIM_MAX_LATENCY_NS)
+		return -ERANGE;
+	return 0;
+}
+
+static ssize_t read_latency_ns_show(struct device *dev,
+									struct device_attribute *attr, char *buf)
+{
+	struct mmio_sim_bank *sim = to_sim_bank(dev_get_drvdata(dev));
+
+	return sprintf(buf, "%u\n", READ_ONCE(sim->read_latency_ns));
+}
+
+static ssize_t read_latency_ns_store(struct device *dev,
+									 struct device_attribute *attr, const char *buf, size_t size)
+{
+	struct mmio_sim_bank *sim = to_sim_bank(dev_get_drvdata(dev));
+	unsigned int ns;
+	int ret;
+
+	ret = mmio_sim_parse_latency(buf, &ns);
+	if (ret)
+		return ret;
+
+	WRITE_ONCE(sim->read_latency_ns, ns);
+	return size;
+}
+static DEVICE_ATTR_RW(read_latency_ns);
+
+static ssize_t write_latency_ns_show(struct device *dev,
+									 struct device_attribute *attr, char *buf)
+{
+	struct mmio_sim_bank *sim = to_sim_bank(dev_get_drvdata(dev));
+
+	return sprintf(buf, "%u\n", READ_ONCE(sim->write_latency_ns));
+}
+
+static ssize_t write_latency_ns_store(struct device *dev,
+									  struct device_attribute *attr, const char *buf, size_t size)
+{
+	struct mmio_sim_bank *sim = to_sim_bank(dev_get_drvdata(dev));
+	unsigned int ns;
+	int ret;
+
+	ret = mmio_sim_parse_latency(buf, &ns);
+	if (ret)
+		return ret;
+
+	WRITE_ONCE(sim->write_latency_ns, ns);
+	return size;
+}
+static DEVICE_ATTR_RW(write_latency_ns);
+
+static struct attribute *mmio_sim_attrs[] = {
+	&dev_attr_read_latency_ns.attr,
+	&dev_attr_write_latency_ns.attr,
+	NULL,
+};
+
+static const struct attribute_group mmio_sim_group = {
+	.name  = "sim",
+	.attrs = mmio_sim_attrs,
+};
+
+static void mmio_sim_remove(struct mmio_sim_bank *sim)
+{
+	sysfs_remove_group(&sim->mmio_cdev.dev->kobj, &mmio_sim_group);
+	mmio_classdev_unregister(&sim->mmio_cdev);
+	free_page((unsigned long) sim->mmio_cdev.base);
+}
+
+static int mmio_sim_add(struct mmio_sim_bank *sim)
+{
+	struct mmio_classdev *mmio_cdev = &sim->mmio_cdev;
+	int ret;
+
+	mmio_cdev->base = (void *) get_zeroed_page(GFP_KERNEL);
+	if (!mmio_cdev->base)
+		return -ENOMEM;
+
+	mmio_cdev->ops = &mmio_sim_ops;
+	sim->read_latency_ns = min_t(unsigned int, read_latency_ns, MMIO_SIM_MAX_LATENCY_NS);
+	sim->write_latency_ns = min_t(unsigned int, write_latency_ns, MMIO_SIM_MAX_LATENCY_NS);
+
+	ret = mmio_classdev_register(NULL, mmio_cdev);
+	if (ret)
+		goto failed_free;
+
+	ret = sysfs_create_group(&mmio_cdev->dev->kobj, &mmio_sim_group);
+	if (ret)
+		goto failed_unregister;
+
+	return 0;
+
+	failed_unregister:
+	mmio_classdev_unregister(mmio_cdev);
+	failed_free:
+	free_page((unsigned long) mmio_cdev->base);
+	return ret;
+}
+
+static int __init mmio_sim_init(void)
+{
+	int i, ret;
+
+	for (i = 0; i < ARRAY_SIZE(mmio_sim_banks); i++)
+	{
+		ret = mmio_sim_add(&mmio_sim_banks[i]);
+		if (ret)
+		{
+			printk(KERN_ERR "%s: Failed to add simulated bank %s\n", __FUNCTION__,
+				   mmio_sim_banks[i].mmio_cdev.name);
+			goto failed_remove;
+		}
+	}
+
+	return 0;
+
+	failed_remove:
+	for (i--; i >= 0; i--)
+		mmio_sim_remove(&mmio_sim_banks[i]);
+	return ret;
+}
+
+static void __exit mmio_sim_exit(void)
+{
+	int i;
+
+	for (i = ARRAY_SIZE(mmio_sim_banks) - 1; i >= 0; i--)
+		mmio_sim_remove(&mmio_sim_banks[i]);
+}
+
+module_init(mmio_sim_init);
+module_exit(mmio_sim_exit);
+
+MODULE_AUTHOR("Joe Balough <jbb5044@gmail.com>");
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("MMIO Simulated Banks");
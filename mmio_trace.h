@@ -0,0 +1,104 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM mmio
+
+#if !defined(__MMIO_TRACE_H_INCLUDED) || defined(TRACE_HEADER_MULTI_READ)
+#define __MMIO_TRACE_H_INCLUDED
+
+#include <linux/tracepoint.h>
+#include "mmio.h"
+
+/*
+ * One event per mmio_get_value or mmio_set_value. raw is the whole register
+ * as read or as written, value is the entry's field. duration_ns covers the
+ * access including any wait for the register's lock, and caller is the
+ * function that called mmio_get_value or mmio_set_value.
+ */
+DECLARE_EVENT_CLASS(mmio_access,
+
+	TP_PROTO(struct mmio_classdev *mmio_cdev, struct mmio_entry *entry,
+			 u64 raw, u64 value, u64 duration_ns, unsigned long caller),
+
+	TP_ARGS(mmio_cdev, entry, raw, value, duration_ns, caller),
+
+	TP_STRUCT__entry(
+		__string(bank, mmio_cdev->name)
+		__string(entry, entry->name)
+		__field(unsigned int, offset)
+		__field(u64, raw)
+		__field(u64, value)
+		__field(u64, duration_ns)
+		__field(unsigned long, caller)
+	),
+
+	TP_fast_assign(
+		__assign_str(bank);
+		__assign_str(entry);
+		__entry->offset = mmio_cdev->offset + entry->offset;
+		__entry->raw = raw;
+		__entry->value = value;
+		__entry->duration_ns = duration_ns;
+		__entry->caller = caller;
+	),
+
+	TP_printk("bank=%s entry=%s offset=0x%x raw=0x%llx value=%llu duration_ns=%llu caller=%pS",
+			  __get_str(bank), __get_str(entry), __entry->offset,
+			  (unsigned long long) __entry->raw, (unsigned long long) __entry->value,
+			  (unsigned long long) __entry->duration_ns, (void *) __entry->caller)
+);
+
+DEFINE_EVENT(mmio_access, mmio_read,
+	TP_PROTO(struct mmio_classdev *mmio_cdev, struct mmio_entry *entry,
+			 u64 raw, u64 value, u64 duration_ns, unsigned long caller),
+	TP_ARGS(mmio_cdev, entry, raw, value, duration_ns, caller)
+);
+
+DEFINE_EVENT(mmio_access, mmio_write,
+	TP_PROTO(struct mmio_classdev *mmio_cdev, struct mmio_entry *entry,
+			 u64 raw, u64 value, u64 duration_ns, unsigned long caller),
+	TP_ARGS(mmio_cdev, entry, raw, value, duration_ns, caller)
+);
+
+/*
+ * A single bus access that took longer than its bank's slow_threshold_us.
+ * Only checked while the bank statistics are enabled, which time every access.
+ */
+TRACE_EVENT(mmio_slow_access,
+
+	TP_PROTO(struct mmio_classdev *mmio_cdev, struct mmio_reg *reg,
+			 bool write, u64 raw, u64 duration_ns),
+
+	TP_ARGS(mmio_cdev, reg, write, raw, duration_ns),
+
+	TP_STRUCT__entry(
+		__string(bank, mmio_cdev->name)
+		__field(unsigned int, offset)
+		__field(u8, size)
+		__field(bool, write)
+		__field(u64, raw)
+		__field(u64, duration_ns)
+	),
+
+	TP_fast_assign(
+		__assign_str(bank);
+		__entry->offset = mmio_cdev->offset + reg->offset;
+		__entry->size = reg->size;
+		__entry->write = write;
+		__entry->raw = raw;
+		__entry->duration_ns = duration_ns;
+	),
+
+	TP_printk("bank=%s offset=0x%x size=%u %s raw=0x%llx duration_ns=%llu",
+			  __get_str(bank), __entry->offset, __entry->size,
+			  __entry->write ? "write" : "read",
+			  (unsigned long long) __entry->raw, (unsigned long long) __entry->duration_ns)
+);
+
+#endif
+
+// Out-of-tree: look for this header next to mmio_core.c, see the Makefile
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE mmio_trace
+
+#include <trace/define_trace.h>
@@ -0,0 +1,131 @@
+/*
+ * MMIO wait for a value
+ *
+ * Copyright (C) 2014 Joe Balough <jbb5044@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * mmio_wait_value polls an entry until it holds a value, the way
+ * read_poll_timeout() does: read, check, pause, with the pause starting at
+ * MMIO_WAIT_MIN_US and doubling up to MMIO_WAIT_MAX_US. Short pauses are
+ * busy-waited, longer ones slept, so a done bit that clears within a few
+ * microseconds is caught right away while a slow one doesn't burn the CPU.
+ * It backs the bank's "wait" attribute and MMIO_IOC_WAIT.
+ *
+ * What is waited for is the hardware changing, so cached banks are read from
+ * the bus rather than the shadow.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/delay.h>
+#include <linux/device.h>
+#include <linux/ktime.h>
+#include <linux/sched/signal.h>
+#include <linux/string.h>
+#include "mmio_watch.h"
+
+#define MMIO_WAIT_MIN_US    1
+#define MMIO_WAIT_MAX_US    1000
+#define MMIO_WAIT_SPIN_US   10        // Pauses below this are busy-waited
+
+#define MMIO_WAIT_SYSFS_DEFAULT_US  1000000
+
+/**
+ * mmio_wait_value - Wait until an entry holds a value
+ * @parent     The mmio_classdev bank containing the entry
+ * @entry      The mmio_entry to poll
+ * @value      The value to wait for
+ * @mask       The bits of the field to compare, 0 for all of them
+ * @timeout_us How long to wait, 0 to check only once, at most
+ *             MMIO_WAIT_MAX_TIMEOUT_US
+ *
+ * Returns 0 once (field & mask) == (value & mask), -ETIMEDOUT if that didn't
+ * happen within timeout_us, or -EINTR if a signal arrived first. The entry
+ * is read once more after the timeout, so a late wake up doesn't fail a wait
+ * that would have succeeded. Fails with -EOPNOTSUPP on MMIO_BANK_WRITE_ONLY
+ * banks, whose registers can't be read. May sleep.
+ *
+ * The timeout is bounded because callers such as MMIO_IOC_WAIT and the
+ * "wait" attribute keep the bank from being unregistered while they wait.
+ */
+int mmio_wait_value(struct mmio_classdev *parent, struct mmio_entry *entry,
+					u64 value, u64 mask, u64 timeout_us)
+{
+	unsigned int delay_us = MMIO_WAIT_MIN_US;
+	ktime_t deadline;
+	// A wait without timeout reads once
+	bool timed_out = !timeout_us;
+
+	might_sleep();
+
+	if (!parent || !entry)
+		return -EINVAL;
+	if (entry < parent->entries || entry >= parent->entries + parent->num_entries)
+		return -EINVAL;
+	if (!entry->mask)
+		return -ENOENT;
+	if (! (entry->flags & MMIO_ENTRY_READ) )
+		return -EPERM;
+	if (parent->flags & MMIO_BANK_WRITE_ONLY)
+		return -EOPNOTSUPP;
+	if (timeout_us > MMIO_WAIT_MAX_TIMEOUT_US)
+		return -EINVAL;
+
+	if (!mask)
+		mask = entry->mask >> entry->shift;
+	deadline = ktime_add_us(ktime_get(), timeout_us);
+
+	for (;;)
+	{
+		if (!((mmio_get_value_bus(parent, entry) ^ value) & mask))
+			return 0;
+		if (timed_out)
+			return -ETIMEDOUT;
+		if (signal_pending(current))
+			return -EINTR;
+
+		if (delay_us < MMIO_WAIT_SPIN_US)
+			udelay(delay_us);
+		else
+			usleep_range(delay_us, delay_us * 2);
+		delay_us = min_t(unsigned int, delay_us * 2, MMIO_WAIT_MAX_US);
+
+		timed_out = ktime_after(ktime_get(), deadline);
+	}
+}
+EXPORT_SYMBOL_GPL(mmio_wait_value);
+
+/**
+ * mmio_wait_store - Sysfs interface to wait until an entry holds a value.
+ *
+ * Takes "<entry> <value> [<mask> [<timeout_us>]]", numbers in decimal, 0x
+ * hex or 0 octal. The write returns once the value is there, or fails with
+ * ETIMEDOUT. The timeout defaults to a second and may be at most 10 s
+ * (MMIO_WAIT_MAX_TIMEOUT_US).
+ */
+ssize_t mmio_wait_store(struct device *dev, struct device_attribute *attr,
+						const char *buf, size_t size)
+{
+	struct mmio_classdev *mmio_cdev = dev_get_drvdata(dev);
+	struct mmio_entry *entry;
+	char name[MMIO_NAME_MAX], arg[3][24];
+	u64 value, mask = 0, timeout_us = MMIO_WAIT_SYSFS_DEFAULT_US;
+	int n, ret;
+
+	// The widths follow MMIO_NAME_MAX and arg
+	n = sscanf(buf, "%31s %23s %23s %23s", name, arg[0], arg[1], arg[2]);
+	if (n < 2 || kstrtou64(arg[0], 0, &value))
+		return -EINVAL;
+	if ((n > 2 && kstrtou64(arg[1], 0, &mask)) || (n > 3 && kstrtou64(arg[2], 0, &timeout_us)))
+		return -EINVAL;
+
+	entry = mmio_watch_find(mmio_cdev, name);
+	if (!entry)
+		return -ENOENT;
+
+	ret = mmio_wait_value(mmio_cdev, entry, value, mask, timeout_us);
+	return ret ? ret : size;
+}
@@ -0,0 +1,490 @@
+/*
+ * MMIO change watcher
+ *
+ * Copyright (C) 2014 Joe Balough <jbb5044@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Watched entries are polled from one delayed work per bank, and the entry's
+ * attribute is sysfs_notify()ed whenever its value changes, so userspace can
+ * poll() the attribute instead of spinning on it. Changes also go to the
+ * entry's notifiers and event fds, see mmio_notify_change. An entry with a
+ * condition is notified only when it is met instead, see mmio_cond.c. Writes through
+ * mmio_set_value are reported the same way, but only while mmio_notify_key
+ * says someone listens: a watched entry, an irq, a notifier or an event fd.
+ *
+ * Notifying takes spinlocks that sleep on PREEMPT_RT, so it never happens
+ * in hard IRQ context: the irq handler is threaded and writes through
+ * mmio_set_value_atomic aren't reported.
+ *
+ * An entry is polled either every interval_ms or adaptively: starting at
+ * MMIO_WATCH_MIN_MS, the interval doubles while nothing changes, up to
+ * MMIO_WATCH_MAX_MS, and drops back to the minimum on a change. Intervals
+ * are rounded up to jiffies.
+ *
+ * Banks with an irq get a threaded handler instead of, or on top of, the
+ * polling. With an irq_status entry the handler reads that register once,
+ * decodes every readable entry of the register from that snapshot and
+ * notifies the ones that changed; a zero status means the interrupt wasn't
+ * ours. The status value is then written to irq_ack, if any, which suits
+ * write-one-to-clear status registers. Without irq_status every watched
+ * entry is read right away instead. On cached banks the status entry should
+ * be MMIO_ENTRY_VOLATILE, or the handler will only see the shadow.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/device.h>
+#include <linux/interrupt.h>
+#include <linux/jiffies.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/sysfs.h>
+#include <linux/workqueue.h>
+#include "mmio_watch.h"
+
+#define MMIO_WATCH_MIN_MS  1
+#define MMIO_WATCH_MAX_MS  1000
+
+/*
+ * Tell everyone waiting on an entry that it changed: poll()ers of its
+ * attribute, event fds and notifiers. Safe from any context but hard IRQ.
+ */
+static void mmio_notify_change(struct mmio_classdev *mmio_cdev, struct mmio_entry *entry,
+							   u64 old, u64 value, unsigned long source)
+{
+	struct mmio_watch *wt = &mmio_cdev->watcher->entries[entry - mmio_cdev->entries];
+	struct mmio_change change = {
+		.mmio_cdev = mmio_cdev,
+		.entry     = entry,
+		.old       = old,
+		.value     = value,
+	};
+
+	if (wt->kn)
+		sysfs_notify_dirent(wt->kn);
+	mmio_event_post(mmio_cdev, entry, old, value);
+	atomic_notifier_call_chain(&wt->notifiers, source, &change);
+}
+
+// Record a value observed by the poll or the interrupt, and notify a change
+static bool mmio_watch_update(struct mmio_watcher *w, unsigned int i, u64 value,
+							  unsigned long source)
+{
+	struct mmio_classdev *mmio_cdev = w->mmio_cdev;
+	u64 old = atomic64_xchg(&w->entries[i].last, value);
+
+	if (mmio_cond_notify(w, i, old, value))
+		mmio_notify_change(mmio_cdev, &mmio_cdev->entries[i], old, value, source);
+	return old != value;
+}
+
+/**
+ * mmio_notify_write - Report a write by mmio_set_value or mmio_commit
+ * @mmio_cdev The bank containing the entry
+ * @entry     The written entry
+ * @old       The field's value before the write
+ * @value     The value written
+ *
+ * Only called while mmio_notify_key is on, i.e. someone may be listening,
+ * and never by mmio_set_value_atomic.
+ */
+void mmio_notify_write(struct mmio_classdev *mmio_cdev, struct mmio_entry *entry,
+					   u64 old, u64 value)
+{
+	struct mmio_watcher *w = mmio_cdev->watcher;
+	unsigned int i = entry - mmio_cdev->entries;
+
+	if (!w)
+		return;
+
+	// The watcher then won't report the same change again
+	atomic64_set(&w->entries[i].last, value);
+	if (mmio_cond_notify(w, i, old, value))
+		mmio_notify_change(mmio_cdev, entry, old, value, MMIO_CHANGE_WRITE);
+}
+
+static void mmio_watch_work(struct work_struct *work)
+{
+	struct mmio_watcher *w = container_of(to_delayed_work(work), struct mmio_watcher, work);
+	struct mmio_classdev *mmio_cdev = w->mmio_cdev;
+	struct mmio_watch *wt;
+	unsigned long now = jiffies, next = 0;
+	bool any = false;
+	unsigned int i;
+	u64 value;
+
+	mutex_lock(&w->lock);
+	for (i = 0; i < mmio_cdev->num_entries; i++)
+	{
+		wt = &w->entries[i];
+		if (!wt->active)
+			continue;
+
+		if (time_after_eq(now, wt->next))
+		{
+			value = mmio_get_value(mmio_cdev, &mmio_cdev->entries[i]);
+			if (mmio_watch_update(w, i, value, MMIO_CHANGE_POLL))
+			{
+				if (!wt->interval_ms)
+					wt->cur_ms = MMIO_WATCH_MIN_MS;
+			}
+			else if (!wt->interval_ms)
+			{
+				wt->cur_ms = min_t(unsigned int, wt->cur_ms * 2, MMIO_WATCH_MAX_MS);
+			}
+			wt->next = now + msecs_to_jiffies(wt->cur_ms);
+		}
+
+		if (!any || time_before(wt->next, next))
+			next = wt->next;
+		any = true;
+	}
+	mutex_unlock(&w->lock);
+
+	if (any)
+		queue_delayed_work(system_wq, &w->work, time_after(next, now) ? next - now : 0);
+}
+
+// Entries whose value is decoded from the irq_status snapshot
+static inline bool mmio_watch_in_status(struct mmio_classdev *mmio_cdev, struct mmio_entry *entry)
+{
+	return entry->mask && (entry->flags & MMIO_ENTRY_READ) && entry->reg == mmio_cdev->irq_status->reg;
+}
+
+static irqreturn_t mmio_watch_irq(int irq, void *data)
+{
+	struct mmio_watcher *w = data;
+	struct mmio_classdev *mmio_cdev = w->mmio_cdev;
+	struct mmio_entry *entry;
+	unsigned int i;
+	u64 status = 0, raw;
+
+	mutex_lock(&w->lock);
+	if (mmio_cdev->irq_status)
+	{
+		status = mmio_get_value_raw(mmio_cdev, mmio_cdev->irq_status, &raw);
+		if (!status)
+		{
+			mutex_unlock(&w->lock);
+			return IRQ_NONE;
+		}
+
+		for (i = 0; i < mmio_cdev->num_entries; i++)
+		{
+			entry = &mmio_cdev->entries[i];
+			if (mmio_watch_in_status(mmio_cdev, entry))
+				mmio_watch_update(w, i, (raw & entry->mask) >> entry->shift, MMIO_CHANGE_IRQ);
+		}
+	}
+	else
+	{
+		for (i = 0; i < mmio_cdev->num_entries; i++)
+			if (w->entries[i].active)
+				mmio_watch_update(w, i, mmio_get_value(mmio_cdev, &mmio_cdev->entries[i]),
+								  MMIO_CHANGE_IRQ);
+	}
+	mutex_unlock(&w->lock);
+
+	if (mmio_cdev->irq_ack)
+		mmio_set_value(mmio_cdev, mmio_cdev->irq_ack, status);
+
+	return IRQ_HANDLED;
+}
+
+/**
+ * mmio_watch - Start or retune watching an entry for changes
+ * @parent      The mmio_classdev bank containing the entry
+ * @entry       The mmio_entry to watch
+ * @interval_ms How often to poll it, 0 for adaptively
+ */
+int mmio_watch(struct mmio_classdev *parent, struct mmio_entry *entry, unsigned int interval_ms)
+{
+	struct mmio_watch *wt;
+	int ret;
+
+	ret = mmio_watch_check(parent, entry);
+	if (ret)
+		return ret;
+
+	wt = &parent->watcher->entries[entry - parent->entries];
+	mutex_lock(&parent->watcher->lock);
+	if (!wt->active)
+	{
+		atomic64_set(&wt->last, mmio_get_value(parent, entry));
+		static_branch_inc(&mmio_notify_key);
+	}
+	wt->active = true;
+	wt->interval_ms = interval_ms;
+	wt->cur_ms = interval_ms ? interval_ms : MMIO_WATCH_MIN_MS;
+	wt->next = jiffies + msecs_to_jiffies(wt->cur_ms);
+	mutex_unlock(&parent->watcher->lock);
+
+	// Let the work pick the new schedule up
+	mod_delayed_work(system_wq, &parent->watcher->work, 0);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(mmio_watch);
+
+/**
+ * mmio_unwatch - Stop watching an entry
+ * @parent The mmio_classdev bank containing the entry
+ * @entry  The watched mmio_entry
+ */
+void mmio_unwatch(struct mmio_classdev *parent, struct mmio_entry *entry)
+{
+	struct mmio_watch *wt;
+
+	if (mmio_watch_check(parent, entry))
+		return;
+
+	wt = &parent->watcher->entries[entry - parent->entries];
+	mutex_lock(&parent->watcher->lock);
+	if (wt->active)
+		static_branch_dec(&mmio_notify_key);
+	wt->active = false;
+	mutex_unlock(&parent->watcher->lock);
+}
+EXPORT_SYMBOL_GPL(mmio_unwatch);
+
+/**
+ * mmio_entry_register_notifier - Get called back when an entry changes
+ * @parent The mmio_classdev bank containing the entry
+ * @entry  The mmio_entry
+ * @nb     The notifier; its action is the MMIO_CHANGE_* source of the change
+ *         and its data a struct mmio_change
+ *
+ * Changes are seen by writes through mmio_set_value, the watcher's polling
+ * and the bank's interrupt, so the entry must be watched to catch changes
+ * made by the hardware. Callbacks may run in any context and must not sleep.
+ */
+int mmio_entry_register_notifier(struct mmio_classdev *parent, struct mmio_entry *entry,
+								 struct notifier_block *nb)
+{
+	int ret;
+
+	if (!parent || !parent->watcher || !entry ||
+		entry < parent->entries || entry >= parent->entries + parent->num_entries)
+		return -EINVAL;
+
+	ret = atomic_notifier_chain_register(&parent->watcher->entries[entry - parent->entries].notifiers, nb);
+	if (!ret)
+		static_branch_inc(&mmio_notify_key);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(mmio_entry_register_notifier);
+
+/**
+ * mmio_entry_unregister_notifier - Undo mmio_entry_register_notifier
+ *
+ * All notifiers must be unregistered before the bank is.
+ */
+int mmio_entry_unregister_notifier(struct mmio_classdev *parent, struct mmio_entry *entry,
+								   struct notifier_block *nb)
+{
+	int ret;
+
+	if (!parent || !parent->watcher || !entry ||
+		entry < parent->entries || entry >= parent->entries + parent->num_entries)
+		return -EINVAL;
+
+	ret = atomic_notifier_chain_unregister(&parent->watcher->entries[entry - parent->entries].notifiers, nb);
+	if (!ret)
+		static_branch_dec(&mmio_notify_key);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(mmio_entry_unregister_notifier);
+
+/**
+ * mmio_watch_show - Sysfs interface listing the watched entries of a bank.
+ *
+ * One "<entry> <interval_ms>" or "<entry> adaptive" line per watched entry.
+ */
+ssize_t mmio_watch_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	struct mmio_classdev *mmio_cdev = dev_get_drvdata(dev);
+	struct mmio_watcher *w = mmio_cdev->watcher;
+	struct mmio_watch *wt;
+	ssize_t len = 0;
+	unsigned int i;
+
+	mutex_lock(&w->lock);
+	for (i = 0; i < mmio_cdev->num_entries; i++)
+	{
+		wt = &w->entries[i];
+		if (!wt->active)
+			continue;
+		if (wt->interval_ms)
+			len += scnprintf(buf + len, PAGE_SIZE - len, "%s %u\n",
+							 mmio_cdev->entries[i].name, wt->interval_ms);
+		else
+			len += scnprintf(buf + len, PAGE_SIZE - len, "%s adaptive\n",
+							 mmio_cdev->entries[i].name);
+	}
+	mutex_unlock(&w->lock);
+
+	return len;
+}
+
+/**
+ * mmio_watch_store - Sysfs interface to watch an entry of a bank.
+ *
+ * Takes "<entry> <interval_ms>", "<entry> adaptive" or "<entry> off".
+ */
+ssize_t mmio_watch_store(struct device *dev, struct device_attribute *attr,
+						 const char *buf, size_t size)
+{
+	struct mmio_classdev *mmio_cdev = dev_get_drvdata(dev);
+	struct mmio_entry *entry;
+	char name[MMIO_NAME_MAX], mode[16];
+	unsigned int interval_ms;
+	int ret;
+
+	// The widths follow MMIO_NAME_MAX and mode
+	if (sscanf(buf, "%31s %15s", name, mode) != 2)
+		return -EINVAL;
+
+	entry = mmio_watch_find(mmio_cdev, name);
+	if (!entry)
+		return -ENOENT;
+
+	if (!strcmp(mode, "off"))
+	{
+		mmio_unwatch(mmio_cdev, entry);
+		return size;
+	}
+
+	if (!strcmp(mode, "adaptive"))
+		interval_ms = 0;
+	else if (kstrtouint(mode, 10, &interval_ms) || !interval_ms)
+		return -EINVAL;
+
+	ret = mmio_watch(mmio_cdev, entry, interval_ms);
+	return ret ? ret : size;
+}
+
+static int mmio_watch_check_irq(struct mmio_classdev *mmio_cdev)
+{
+	struct mmio_entry *status = mmio_cdev->irq_status, *ack = mmio_cdev->irq_ack;
+	struct mmio_entry *end = mmio_cdev->entries + mmio_cdev->num_entries;
+
+	if ((status || ack) && mmio_cdev->irq <= 0)
+		return -EINVAL;
+	if (ack && !status)
+		return -EINVAL;
+	if (status && (status < mmio_cdev->entries || status >= end || !status->mask ||
+				   ! (status->flags & MMIO_ENTRY_READ)))
+		return -EINVAL;
+	if (ack && (ack < mmio_cdev->entries || ack >= end || !ack->mask ||
+				! (ack->flags & MMIO_ENTRY_WRITE)))
+		return -EINVAL;
+	return 0;
+}
+
+/**
+ * mmio_watch_add - Set up a bank's watcher, its interrupt and its MMIO_ENTRY_WATCH entries.
+ */
+int mmio_watch_add(struct mmio_classdev *mmio_cdev)
+{
+	struct mmio_watcher *w;
+	unsigned int i;
+	u64 raw;
+	int ret;
+
+	ret = mmio_watch_check_irq(mmio_cdev);
+	if (ret)
+		return ret;
+
+	w = kzalloc(struct_size(w, entries, mmio_cdev->num_entries), GFP_KERNEL);
+	if (!w)
+		return -ENOMEM;
+
+	w->mmio_cdev = mmio_cdev;
+	mutex_init(&w->lock);
+	INIT_DELAYED_WORK(&w->work, mmio_watch_work);
+	spin_lock_init(&w->event_lock);
+	INIT_LIST_HEAD(&w->event_subs);
+	spin_lock_init(&w->cond_lock);
+	mmio_cdev->watcher = w;
+
+	for (i = 0; i < mmio_cdev->num_entries; i++)
+	{
+		ATOMIC_INIT_NOTIFIER_HEAD(&w->entries[i].notifiers);
+		// sysfs_notify() may sleep, sysfs_notify_dirent() doesn't
+		if (mmio_cdev->entries[i].mask)
+			w->entries[i].kn = sysfs_get_dirent(mmio_cdev->dev->kobj.sd,
+												mmio_cdev->entries[i].name);
+	}
+
+	for (i = 0; i < mmio_cdev->num_entries; i++)
+	{
+		if (! (mmio_cdev->entries[i].flags & MMIO_ENTRY_WATCH) || !mmio_cdev->entries[i].mask)
+			continue;
+
+		ret = mmio_watch(mmio_cdev, &mmio_cdev->entries[i], mmio_cdev->entries[i].watch_ms);
+		if (ret)
+		{
+			mmio_watch_del(mmio_cdev);
+			return ret;
+		}
+	}
+
+	if (mmio_cdev->irq > 0)
+	{
+		// Changes are relative to the status at registration
+		if (mmio_cdev->irq_status)
+		{
+			mmio_get_value_raw(mmio_cdev, mmio_cdev->irq_status, &raw);
+			for (i = 0; i < mmio_cdev->num_entries; i++)
+				if (mmio_watch_in_status(mmio_cdev, &mmio_cdev->entries[i]))
+					atomic64_set(&w->entries[i].last, (raw & mmio_cdev->entries[i].mask) >>
+												  mmio_cdev->entries[i].shift);
+		}
+
+		// The status may only be readable from process context
+		ret = request_threaded_irq(mmio_cdev->irq, NULL, mmio_watch_irq,
+								   IRQF_ONESHOT | mmio_cdev->irq_flags, mmio_cdev->name, w);
+		if (ret)
+		{
+			mmio_watch_del(mmio_cdev);
+			return ret;
+		}
+		w->irq = true;
+		static_branch_inc(&mmio_notify_key);
+	}
+
+	return 0;
+}
+
+void mmio_watch_del(struct mmio_classdev *mmio_cdev)
+{
+	struct mmio_watcher *w = mmio_cdev->watcher;
+	unsigned int i;
+
+	// Detached by mmio_cdev_del, or the bank never was reachable
+	WARN_ON(!list_empty(&w->event_subs));
+
+	if (w->irq)
+	{
+		free_irq(mmio_cdev->irq, w);
+		static_branch_dec(&mmio_notify_key);
+	}
+	// The work requeues itself, so stop it for good
+	cancel_delayed_work_sync(&w->work);
+
+	for (i = 0; i < mmio_cdev->num_entries; i++)
+	{
+		if (w->entries[i].active)
+			static_branch_dec(&mmio_notify_key);
+		if (w->entries[i].cond)
+			static_branch_dec(&mmio_notify_key);
+		kfree(w->entries[i].cond);
+		sysfs_put(w->entries[i].kn);
+	}
+
+	mmio_cdev->watcher = NULL;
+	kfree(w);
+}
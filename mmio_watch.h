@@ -0,0 +1,73 @@
+#ifndef __MMIO_WATCH_H_INCLUDED
+#define __MMIO_WATCH_H_INCLUDED
+
+#include <linux/atomic.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/notifier.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+#include <linux/workqueue.h>
+#include "mmio_internal.h"
+
+struct kernfs_node;
+struct mmio_cond_state;
+
+/*
+ * Change notification state of a bank, see mmio_watch.c. event_subs lists
+ * the event fds subscribed to the bank, see mmio_event.c. last is swapped
+ * atomically by whoever observes a value, so that writes, polls and
+ * interrupts report each change only once. cond is the entry's
+ * condition, see mmio_cond.c.
+ */
+struct mmio_watch {
+	bool           active;         // Polled, under the watcher's lock
+	unsigned int   interval_ms;    // 0 for adaptive
+	unsigned int   cur_ms;         // Interval until the next poll
+	unsigned long  next;           // jiffies of the next poll
+	atomic64_t     last;           // Last value observed
+	struct kernfs_node           *kn;  // The entry's attribute, for sysfs_notify_dirent
+	struct atomic_notifier_head  notifiers;
+	struct mmio_cond_state       *cond;  // Under the watcher's cond_lock
+};
+
+struct mmio_watcher {
+	struct mmio_classdev  *mmio_cdev;
+	struct mutex          lock;    // Protects the polling state of entries
+	struct delayed_work   work;
+	bool                  irq;     // The bank's irq is requested
+	spinlock_t            event_lock;  // Protects event_subs, taken from any context but hard IRQ
+	struct list_head      event_subs;
+	spinlock_t            cond_lock;   // Protects the entries' cond, taken from any context but hard IRQ
+	struct mmio_watch     entries[];  // One per entry of the bank
+};
+
+// Validate an entry to watch, with a watcher to watch it
+static inline int mmio_watch_check(struct mmio_classdev *parent, struct mmio_entry *entry)
+{
+	if (!parent || !parent->watcher || !entry)
+		return -EINVAL;
+	if (entry < parent->entries || entry >= parent->entries + parent->num_entries)
+		return -EINVAL;
+	if (!entry->mask)
+		return -ENOENT;
+	if (! (entry->flags & MMIO_ENTRY_READ) )
+		return -EPERM;
+	return 0;
+}
+
+// The entry of a bank named name, for the sysfs interfaces
+static inline struct mmio_entry *mmio_watch_find(struct mmio_classdev *mmio_cdev, const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < mmio_cdev->num_entries; i++)
+		if (mmio_cdev->entries[i].mask && !strcmp(mmio_cdev->entries[i].name, name))
+			return &mmio_cdev->entries[i];
+	return NULL;
+}
+
+// mmio_cond.c
+extern bool mmio_cond_notify(struct mmio_watcher *w, unsigned int i, u64 old, u64 value);
+
+#endif
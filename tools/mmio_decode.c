@@ -0,0 +1,64 @@
+/*
+ * MMIO compressed sample decoder
+ *
+ * Copyright (C) 2014 Joe Balough <jbb5044@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Usage: mmio_decode index... < stream
+ *
+ * Decodes an MMIO_SAMPLE_COMPRESSED stream saved from a sampler session,
+ * given the entry indices the session was started with, and prints one
+ * "<seq> <time_ns> <index> <value>" line per record.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "mmio_decode.h"
+
+static void print_sample(const struct mmio_sample *rec, void *arg)
+{
+	printf("%u %llu %u %llu\n", rec->seq, (unsigned long long) rec->time_ns,
+		   rec->index, (unsigned long long) rec->value);
+}
+
+int main(int argc, char **argv)
+{
+	static unsigned char buf[1 << 16];
+	__u32 indices[MMIO_SAMPLE_MAX_ENTRIES];
+	struct mmio_decoder d;
+	size_t len = 0, n;
+	long used;
+	int i;
+
+	if (argc < 2 || argc - 1 > MMIO_SAMPLE_MAX_ENTRIES)
+	{
+		fprintf(stderr, "usage: %s index... < stream\n", argv[0]);
+		return 2;
+	}
+	for (i = 1; i < argc; i++)
+		indices[i - 1] = strtoul(argv[i], NULL, 0);
+	mmio_decoder_init(&d, indices, argc - 1);
+
+	while ((n = fread(buf + len, 1, sizeof(buf) - len, stdin)) > 0)
+	{
+		len += n;
+		used = mmio_decode(&d, buf, len, print_sample, NULL);
+		if (used < 0)
+		{
+			fprintf(stderr, "%s: malformed stream\n", argv[0]);
+			return 1;
+		}
+		memmove(buf, buf + used, len - used);
+		len -= used;
+	}
+
+	if (len)
+	{
+		fprintf(stderr, "%s: stream ends in the middle of an item\n", argv[0]);
+		return 1;
+	}
+	return 0;
+}
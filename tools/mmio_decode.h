@@ -0,0 +1,163 @@
+#ifndef __MMIO_DECODE_H_INCLUDED
+#define __MMIO_DECODE_H_INCLUDED
+
+/*
+ * Reference decoder for MMIO_SAMPLE_COMPRESSED sampler streams, see
+ * mmio_ioctl.h. Header only, so it can be copied into an application as is.
+ *
+ * Feed mmio_decode() the bytes read from the session in order. It calls emit
+ * once per entry of every tick with the record an uncompressed session would
+ * have produced, except that ticks inside a run get interpolated times. It
+ * returns the number of bytes consumed; an item cut off at the end of buf is
+ * left unconsumed and must be passed again in front of the next bytes.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include "../mmio_ioctl.h"
+
+struct mmio_decoder {
+	const __u32   *indices;        // The session's mmio_sample_config indices
+	unsigned int  count;
+	__u32         seq;
+	__u64         time;
+	__u64         values[MMIO_SAMPLE_MAX_ENTRIES];
+};
+
+typedef void (*mmio_decode_fn)(const struct mmio_sample *rec, void *arg);
+
+static inline void mmio_decoder_init(struct mmio_decoder *d, const __u32 *indices,
+									 unsigned int count)
+{
+	memset(d, 0, sizeof(*d));
+	d->indices = indices;
+	d->count = count;
+}
+
+// 1 and advances *p if a whole varint was there, 0 if it is cut off, -1 if malformed
+static inline int mmio_decode_varint(const unsigned char **p, const unsigned char *end, __u64 *x)
+{
+	const unsigned char *q = *p;
+	unsigned int shift;
+
+	*x = 0;
+	for (shift = 0; shift < 70; shift += 7)
+	{
+		if (q == end)
+			return 0;
+		*x |= (__u64) (*q & 0x7f) << shift;
+		if (!(*q++ & 0x80))
+		{
+			*p = q;
+			return 1;
+		}
+	}
+	return -1;
+}
+
+static inline void mmio_decode_tick(struct mmio_decoder *d, __u64 time,
+									mmio_decode_fn emit, void *arg)
+{
+	struct mmio_sample rec;
+	unsigned int i;
+
+	for (i = 0; i < d->count; i++)
+	{
+		rec.time_ns = time;
+		rec.value = d->values[i];
+		rec.index = d->indices[i];
+		rec.seq = d->seq;
+		emit(&rec, arg);
+	}
+	d->seq++;
+}
+
+/**
+ * mmio_decode - Decode the complete items at the start of buf
+ *
+ * Returns the bytes consumed, or -1 if the stream is malformed.
+ */
+static inline long mmio_decode(struct mmio_decoder *d, const void *buf, size_t len,
+							   mmio_decode_fn emit, void *arg)
+{
+	const unsigned char *p = buf, *end = p + len, *item, *values;
+	__u64 tag, x, changed, delta, v, k;
+	unsigned int i;
+	int ret;
+
+	for (;;)
+	{
+		item = p;
+		ret = mmio_decode_varint(&p, end, &tag);
+		if (ret <= 0)
+			break;
+		x = tag >> 2;
+
+		switch (tag & 3)
+		{
+			case MMIO_ITEM_TICK:
+				ret = mmio_decode_varint(&p, end, &changed);
+				if (ret <= 0)
+					break;
+				if (d->count < 64 && changed >> d->count)
+				{
+					ret = -1;
+					break;
+				}
+
+				// Make sure the whole item is there before applying any of it
+				values = p;
+				for (i = 0; i < d->count && ret > 0; i++)
+					if (changed & (1ULL << i))
+						ret = mmio_decode_varint(&p, end, &v);
+				if (ret <= 0)
+					break;
+
+				p = values;
+				for (i = 0; i < d->count; i++)
+				{
+					if (changed & (1ULL << i))
+					{
+						mmio_decode_varint(&p, end, &v);
+						d->values[i] ^= v;
+					}
+				}
+				d->time += x;
+				mmio_decode_tick(d, d->time, emit, arg);
+				break;
+
+			case MMIO_ITEM_RUN:
+				ret = mmio_decode_varint(&p, end, &delta);
+				if (ret <= 0)
+					break;
+				if (x == 0)
+				{
+					ret = -1;
+					break;
+				}
+
+				// delta * k could overflow for long periods
+				for (k = 1; k <= x; k++)
+					mmio_decode_tick(d, d->time + delta / x * k + delta % x * k / x, emit, arg);
+				d->time += delta;
+				break;
+
+			case MMIO_ITEM_SKIP:
+				d->seq += x;
+				break;
+
+			default:
+				ret = -1;
+				break;
+		}
+
+		if (ret <= 0)
+			break;
+	}
+
+	if (ret < 0)
+		return -1;
+	return item - (const unsigned char *) buf;
+}
+
+#endif